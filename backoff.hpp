@@ -0,0 +1,143 @@
+/*
+
+Copyright (C) 2019  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENEDIAS_BACKOFF_HPP
+#define BENEDIAS_BACKOFF_HPP
+#include <cstdint>
+
+/// Backoff policies for CAS retry loops.
+/// When many threads CAS the same location, retrying immediately
+/// causes cache line ping-pong, and throughput collapses.
+/// Backing off after a failed CAS reduces the number of concurrent
+/// attempts.
+///
+/// A backoff policy is a class with
+///     - a nested type shared_state, one instance of which is shared by
+///       all threads accessing the same data structure.
+///     - a constructor taking a reference to the shared_state.
+///     - void backoff(), invoked after a failed CAS.
+///     - void reset(), invoked when the CAS loop completes.
+/// Policy instances are per thread.
+namespace benedias {
+    namespace concurrent {
+
+        /// Hint to the processor that the thread is spinning.
+        inline void cpu_relax()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__arm__) || defined(__aarch64__)
+            __asm__ __volatile__("yield" ::: "memory");
+#else
+            __asm__ __volatile__("" ::: "memory");
+#endif
+        }
+
+        inline void cpu_relax(uint32_t spins)
+        {
+            while(spins--)
+            {
+                cpu_relax();
+            }
+        }
+
+        /// Retry immediately.
+        struct backoff_none
+        {
+            struct shared_state {};
+
+            explicit backoff_none(shared_state&) {}
+            inline void backoff() {}
+            inline void reset() {}
+        };
+
+        /// Spin for an exponentially increasing number of pause
+        /// instructions, from MinSpins up to MaxSpins, on consecutive
+        /// failures.
+        template <uint32_t MinSpins=4, uint32_t MaxSpins=1024> class backoff_exponential
+        {
+            uint32_t    spins = MinSpins;
+
+            public:
+            struct shared_state {};
+
+            explicit backoff_exponential(shared_state&) {}
+
+            inline void backoff()
+            {
+                cpu_relax(spins);
+                if (spins < MaxSpins)
+                {
+                    spins <<= 1;
+                }
+            }
+
+            inline void reset()
+            {
+                spins = MinSpins;
+            }
+        };
+
+        /// Spin for a number of pause instructions proportional to
+        /// the number of threads currently retrying CAS operations
+        /// on the same data structure.
+        /// Threads register as contenders on their first failure, so
+        /// uncontended operations do not touch the shared counter.
+        template <uint32_t SpinsPerContender=32> class backoff_proportional
+        {
+            public:
+            struct shared_state
+            {
+                uint32_t    contenders = 0;
+            };
+
+            private:
+            shared_state*   shared;
+            bool            contending = false;
+
+            public:
+            explicit backoff_proportional(shared_state& state):shared(&state) {}
+
+            inline void backoff()
+            {
+                uint32_t contenders;
+                if (!contending)
+                {
+                    contending = true;
+                    contenders = __atomic_add_fetch(&shared->contenders, 1, __ATOMIC_RELAXED);
+                }
+                else
+                {
+                    contenders = __atomic_load_n(&shared->contenders, __ATOMIC_RELAXED);
+                }
+                cpu_relax(contenders * SpinsPerContender);
+            }
+
+            inline void reset()
+            {
+                if (contending)
+                {
+                    contending = false;
+                    __atomic_sub_fetch(&shared->contenders, 1, __ATOMIC_RELAXED);
+                }
+            }
+        };
+
+    } //namespace concurrent
+} //namespace benedias
+#endif // #define BENEDIAS_BACKOFF_HPP
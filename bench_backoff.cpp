@@ -0,0 +1,131 @@
+/*
+
+Copyright (C) 2019  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Throughput of solist CAS backoff policies, and of flat combining,
+under a hot key workload.
+Every thread inserts and deletes the same few keys, which all map to
+a single bucket, so all CAS operations contend on the same cache lines.
+
+usage: bench_backoff [milliseconds per run]
+*/
+#include "solist.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+using   benedias::concurrent::solist;
+using   benedias::concurrent::solist_accessor;
+using   benedias::concurrent::hash_mixer_none;
+using   benedias::concurrent::backoff_none;
+using   benedias::concurrent::backoff_exponential;
+using   benedias::concurrent::backoff_proportional;
+using   benedias::concurrent::hash_t;
+using   benedias::concurrent::solist_reclaim_hazard_pointers;
+using   benedias::concurrent::solist_combining_none;
+using   benedias::concurrent::solist_combining;
+
+// Hash values differ only in the high bits, so all keys
+// are in bucket 0.
+constexpr   unsigned num_hot_keys = 4;
+constexpr   unsigned hot_key_shift = 24;
+const       unsigned thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+template <class Backoff, class Combine> void hot_key_thread_fn(
+        std::shared_ptr<solist<uint32_t, hash_mixer_none, Backoff, solist_reclaim_hazard_pointers, Combine>> sl,
+        unsigned id, bool& go, bool& stop, uint64_t& ops)
+{
+    solist_accessor<uint32_t, hash_mixer_none, Backoff, solist_reclaim_hazard_pointers, Combine> sol(sl);
+    uint64_t count = 0;
+    while(!__atomic_load_n(&go, __ATOMIC_ACQUIRE))
+    {
+        std::this_thread::yield();
+    }
+    for (unsigned x = id; !__atomic_load_n(&stop, __ATOMIC_RELAXED); ++x)
+    {
+        hash_t key = (x % num_hot_keys) << hot_key_shift;
+        sol.insert_node(key, x);
+        sol.delete_node(key);
+        count += 2;
+    }
+    ops = count;
+}
+
+// Combine - flat combining policy.
+template <class Backoff, class Combine> double hot_key_run(unsigned num_threads, unsigned millisecs)
+{
+    // max bucket length is large enough that the bucket never splits.
+    auto sl = std::make_shared<solist<uint32_t, hash_mixer_none, Backoff,
+         solist_reclaim_hazard_pointers, Combine>>(2, 64);
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> ops(num_threads);
+    bool go = false;
+    bool stop = false;
+
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        threads.emplace_back(hot_key_thread_fn<Backoff, Combine>, sl, i,
+                std::ref(go), std::ref(stop), std::ref(ops[i]));
+    }
+    auto start = std::chrono::steady_clock::now();
+    __atomic_store_n(&go, true, __ATOMIC_RELEASE);
+    std::this_thread::sleep_for(std::chrono::milliseconds(millisecs));
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    for (auto& th: threads)
+    {
+        th.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    uint64_t total = 0;
+    for (auto v: ops)
+    {
+        total += v;
+    }
+    return total / elapsed.count();
+}
+
+template <class Backoff, class Combine=solist_combining_none> void hot_key_bench(
+        const char* name, unsigned millisecs)
+{
+    for (auto num_threads: thread_counts)
+    {
+        printf("%-14s %8u %14.0f\n", name, num_threads,
+                hot_key_run<Backoff, Combine>(num_threads, millisecs));
+        fflush(stdout);
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    unsigned millisecs = 200;
+    if (argc > 1)
+    {
+        millisecs = strtoul(argv[1], nullptr, 0);
+    }
+    printf("hot key insert/delete, %u keys, %u ms per run, %u hardware threads\n",
+            num_hot_keys, millisecs, std::thread::hardware_concurrency());
+    printf("%-14s %8s %14s\n", "backoff", "threads", "ops/s");
+    hot_key_bench<backoff_none>("none", millisecs);
+    hot_key_bench<backoff_exponential<>>("exponential", millisecs);
+    hot_key_bench<backoff_proportional<>>("proportional", millisecs);
+    hot_key_bench<backoff_none, solist_combining<10>>("combining", millisecs);
+    return 0;
+}
@@ -0,0 +1,288 @@
+/*
+
+Copyright (C) 2019  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Costs of hazard pointers and memory reclamation.
+    context   - hazard_pointer_context creation and destruction,
+                against the number of pools in the domain.
+    traverse  - protect and store per list traversal step, against
+                an unprotected traversal.
+    collect   - hazptr_domain::collect latency, against the number of
+                hazard pointers H, and against the delete list length.
+    stalled   - peak unreclaimed objects while a reader stalls holding
+                a protected object, for hazard pointers, EBR and QSBR.
+
+Results are machine readable, one record per measurement with the fields
+    benchmark, parameter, value, metric, result, unit
+as CSV (default) or as a JSON array, for tracking regressions.
+
+usage: bench_hazptr [csv|json]
+*/
+#include "hazard_pointer.hpp"
+#include "reclaim_policy.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+using   benedias::concurrent::hazard_pointer_context;
+using   benedias::concurrent::hazard_pointer_domain;
+using   benedias::concurrent::mark_ptr_type;
+using   benedias::concurrent::reclaim_hazard_pointers;
+using   benedias::concurrent::reclaim_epoch;
+using   benedias::concurrent::reclaim_qsbr;
+
+// hazptr_pool::HAZPTR_POOL_BLOCKS, the bits in a pool bitmap.
+constexpr   std::size_t blocks_per_pool = 64;
+
+const   std::size_t pool_counts[] = {1, 2, 4, 8, 16, 32};
+const   std::size_t hazard_counts[] = {8, 64, 512, 4096};
+const   std::size_t delete_list_lengths[] = {64, 256, 1024, 4096, 16384};
+
+// Nodes currently allocated, for measuring unreclaimed memory.
+static  std::size_t live_nodes = 0;
+
+struct node
+{
+    mark_ptr_type<node> next;
+    uint64_t    payload[3] = {};
+
+    node() { __atomic_add_fetch(&live_nodes, 1, __ATOMIC_RELAXED); }
+    ~node() { __atomic_sub_fetch(&live_nodes, 1, __ATOMIC_RELAXED); }
+};
+
+using   node_domain = hazard_pointer_domain<node>;
+
+static  bool json = false;
+static  unsigned records = 0;
+
+static void record(const char* benchmark, const char* parameter, std::size_t value,
+        const char* metric, double result, const char* unit)
+{
+    if (json)
+    {
+        printf("%s\n  {\"benchmark\": \"%s\", \"parameter\": \"%s\", \"value\": %zu, "
+                "\"metric\": \"%s\", \"result\": %.3f, \"unit\": \"%s\"}",
+                records ? "," : "[", benchmark, parameter, value, metric, result, unit);
+    }
+    else
+    {
+        if (0 == records)
+        {
+            printf("benchmark,parameter,value,metric,result,unit\n");
+        }
+        printf("%s,%s,%zu,%s,%.3f,%s\n", benchmark, parameter, value, metric, result, unit);
+    }
+    ++records;
+    fflush(stdout);
+}
+
+template <class Fn> double time_ns(unsigned iterations, Fn fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned x = 0; x < iterations; ++x)
+    {
+        fn();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// Create and destroy a context while the other blocks of every pool
+// are reserved.
+void bench_context()
+{
+    for (auto pools: pool_counts)
+    {
+        auto domain = node_domain::make();
+        std::vector<std::unique_ptr<hazard_pointer_context<node, 1, 32>>> held;
+        for (std::size_t x = 0; x + 1 < pools * blocks_per_pool; ++x)
+        {
+            held.emplace_back(new hazard_pointer_context<node, 1, 32>(domain));
+        }
+        double ns = time_ns(100000, [&]()
+                {
+                    hazard_pointer_context<node, 1, 32> ctx(domain);
+                });
+        record("context", "pools", pools, "create_destroy", ns, "ns");
+    }
+}
+
+// Step along a list protecting each node, as a solist traversal does.
+void bench_traverse()
+{
+    constexpr std::size_t count = 4096;
+    constexpr unsigned iterations = 200;
+    std::vector<node> nodes(count);
+    for (std::size_t x = 0; x + 1 < count; ++x)
+    {
+        nodes[x].next = &nodes[x + 1];
+    }
+    auto domain = node_domain::make();
+    hazard_pointer_context<node, 2, 32> ctx(domain);
+    std::size_t steps = 0;
+
+    double ns = time_ns(iterations, [&]()
+            {
+                bool mark;
+                for (node* cur = &nodes[0]; nullptr != cur; ++steps)
+                {
+                    cur = cur->next(&mark);
+                }
+            });
+    record("traverse", "nodes", count, "unprotected_step", ns / count, "ns");
+
+    ns = time_ns(iterations, [&]()
+            {
+                bool mark;
+                for (node* cur = &nodes[0]; nullptr != cur; ++steps)
+                {
+                    node* next = ctx.protect(0, cur->next, &mark);
+                    // Rotate, as hazard pointers protecting next become
+                    // those protecting cur.
+                    ctx.store(1, next);
+                    cur = next;
+                }
+            });
+    record("traverse", "nodes", count, "protect_store_step", ns / count, "ns");
+    if (steps != 2 * iterations * count)
+    {
+        fprintf(stderr, "traversal steps %zu\n", steps);
+    }
+}
+
+// Time collect of delete_length objects with hazards hazard pointers
+// in the domain, all null, so every object is reclaimed.
+double collect_ns(std::size_t hazards, std::size_t delete_length)
+{
+    constexpr unsigned repeats = 16;
+    auto domain = node_domain::make();
+    std::vector<std::unique_ptr<hazard_pointer_context<node, 1, 32>>> held;
+    for (std::size_t x = 0; x < hazards; ++x)
+    {
+        held.emplace_back(new hazard_pointer_context<node, 1, 32>(domain));
+    }
+    std::vector<node*> items(delete_length);
+    std::vector<double> times;
+    for (unsigned r = 0; r < repeats; ++r)
+    {
+        for (auto& item: items)
+        {
+            item = new node();
+        }
+        domain->enqueue_for_delete(items.data(), items.size());
+        auto start = std::chrono::steady_clock::now();
+        domain->collect();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[repeats / 2];
+}
+
+void bench_collect()
+{
+    for (auto hazards: hazard_counts)
+    {
+        double ns = collect_ns(hazards, 1024);
+        record("collect_vs_h", "hazard_pointers", hazards, "median_latency", ns / 1000, "us");
+    }
+    for (auto length: delete_list_lengths)
+    {
+        double ns = collect_ns(64, length);
+        record("collect_vs_delete_list", "delete_list", length, "median_latency", ns / 1000, "us");
+        record("collect_vs_delete_list", "delete_list", length, "per_object", ns / length, "ns");
+    }
+}
+
+// A reader protects the current node and stalls, while a writer replaces
+// and retires the node retires times.
+// \@return the peak number of unreclaimed nodes.
+template <class Reclaim> std::size_t stalled_reader_peak(std::size_t retires)
+{
+    typename Reclaim::shared_state shared;
+    mark_ptr_type<node> slot(new node());
+    std::size_t baseline = __atomic_load_n(&live_nodes, __ATOMIC_RELAXED);
+    std::size_t peak = 0;
+    bool stalled = false;
+    bool resume = false;
+
+    std::thread reader([&]()
+            {
+                Reclaim r(shared);
+                bool mark;
+                r.begin();
+                r.protect(0, slot, &mark);
+                __atomic_store_n(&stalled, true, __ATOMIC_RELEASE);
+                while(!__atomic_load_n(&resume, __ATOMIC_ACQUIRE))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                r.end();
+            });
+    while(!__atomic_load_n(&stalled, __ATOMIC_ACQUIRE))
+    {
+        std::this_thread::yield();
+    }
+    {
+        Reclaim w(shared);
+        for (std::size_t x = 0; x < retires; ++x)
+        {
+            w.begin();
+            node* old = slot();
+            slot.store(new node());
+            w.retire(old);
+            w.end();
+            peak = std::max(peak, __atomic_load_n(&live_nodes, __ATOMIC_RELAXED) - baseline);
+        }
+        __atomic_store_n(&resume, true, __ATOMIC_RELEASE);
+        reader.join();
+    }
+    delete slot();
+    return peak;
+}
+
+void bench_stalled()
+{
+    constexpr std::size_t retires = 100000;
+    record("stalled_reader", "retires", retires, "hazard_pointers_peak_nodes",
+            stalled_reader_peak<reclaim_hazard_pointers<node, 1, 32>>(retires), "nodes");
+    record("stalled_reader", "retires", retires, "epoch_peak_nodes",
+            stalled_reader_peak<reclaim_epoch<node, 32>>(retires), "nodes");
+    record("stalled_reader", "retires", retires, "qsbr_peak_nodes",
+            stalled_reader_peak<reclaim_qsbr<node, 32>>(retires), "nodes");
+    record("stalled_reader", "node_size", sizeof(node), "node_size", sizeof(node), "bytes");
+}
+
+int main( int argc, char* argv[] )
+{
+    if (argc > 1)
+    {
+        json = 0 == strcmp(argv[1], "json");
+    }
+    bench_context();
+    bench_traverse();
+    bench_collect();
+    bench_stalled();
+    if (json)
+    {
+        printf("\n]\n");
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+
+Copyright (C) 2019  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Cost of testing a batch of R retired pointers against a snapshot of H
+hazard pointers.
+    sort    - sort the snapshot then std::binary_search per item,
+              the scan used by hazptrs_snapshot previously.
+    scalar  - branch free linear scan per item.
+    batch   - hazptr_batch_search, vector compares if supported.
+
+usage: bench_hazptr_search [iterations]
+*/
+#include "hazard_pointer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using   benedias::concurrent::generic_hazptr_t;
+using   benedias::concurrent::hazptr_batch_search;
+using   benedias::concurrent::hazptr_batch_search_scalar;
+using   benedias::concurrent::hazptr_batch_search_isa;
+
+const   std::size_t hazard_counts[] = {8, 16, 32, 64, 128, 256};
+const   std::size_t retired_counts[] = {32, 128};
+
+// Defeat dead code elimination.
+static unsigned sink;
+
+template <class Fn> double time_ns(unsigned iterations, Fn fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned x = 0; x < iterations; ++x)
+    {
+        fn();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void bench(std::size_t nhazards, std::size_t nretired, unsigned iterations, std::mt19937& rng)
+{
+    // Pointer like values, half of the retired items are hazardous.
+    std::vector<generic_hazptr_t> hazards(nhazards);
+    std::vector<generic_hazptr_t> retired(nretired);
+    std::vector<generic_hazptr_t> scratch(nhazards);
+    std::unique_ptr<bool[]> found(new bool[nretired]);
+    auto random_ptr = [&rng]()
+    {
+        return reinterpret_cast<generic_hazptr_t>(static_cast<uintptr_t>(rng()) << 4);
+    };
+    for (auto& h: hazards)
+    {
+        h = random_ptr();
+    }
+    for (std::size_t x = 0; x < nretired; ++x)
+    {
+        retired[x] = (x & 1) ? hazards[rng() % nhazards] : random_ptr();
+    }
+
+    double sort_ns = time_ns(iterations, [&]()
+        {
+            // The snapshot is rebuilt for every scan.
+            std::copy(hazards.begin(), hazards.end(), scratch.begin());
+            std::sort(scratch.begin(), scratch.end());
+            for (std::size_t x = 0; x < nretired; ++x)
+            {
+                found[x] = std::binary_search(scratch.begin(), scratch.end(), retired[x]);
+            }
+            sink += found[0];
+        });
+    double scalar_ns = time_ns(iterations, [&]()
+        {
+            std::copy(hazards.begin(), hazards.end(), scratch.begin());
+            hazptr_batch_search_scalar(scratch.data(), nhazards, retired.data(), nretired, found.get());
+            sink += found[0];
+        });
+    double batch_ns = time_ns(iterations, [&]()
+        {
+            std::copy(hazards.begin(), hazards.end(), scratch.begin());
+            hazptr_batch_search(scratch.data(), nhazards, retired.data(), nretired, found.get());
+            sink += found[0];
+        });
+    printf("%8zu %8zu %12.1f %12.1f %12.1f\n", nhazards, nretired, sort_ns, scalar_ns, batch_ns);
+}
+
+int main( int argc, char* argv[] )
+{
+    unsigned iterations = 20000;
+    if (argc > 1)
+    {
+        iterations = strtoul(argv[1], nullptr, 0);
+    }
+    // Selects the batch search implementation.
+    benedias::concurrent::hazard_pointer_global_init();
+    std::mt19937 rng(42);
+
+    printf("ns per scan, %u iterations, batch search using %s\n",
+            iterations, hazptr_batch_search_isa());
+    printf("%8s %8s %12s %12s %12s\n", "H", "R", "sort", "scalar", "batch");
+    for (auto nretired: retired_counts)
+    {
+        for (auto nhazards: hazard_counts)
+        {
+            bench(nhazards, nretired, iterations, rng);
+        }
+    }
+    return sink == 0xdeadbeef;
+}
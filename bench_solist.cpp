@@ -0,0 +1,472 @@
+/*
+
+Copyright (C) 2019  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Concurrent throughput and latency of solist, compared with a baseline
+of std::unordered_map shards, each protected by a mutex.
+
+YCSB style workloads:
+    read    - 100% lookups.
+    95/5    - 95% lookups, 5% updates.
+    50/50   - 50% lookups, 50% updates.
+    insert  - 100% inserts of new keys, into an initially empty table.
+An update deletes and reinserts a key, so the table size is stable,
+neither table supports updates in place.
+Keys of lookups and updates are drawn uniformly or from a Zipfian
+distribution (theta 0.99, scrambled so hot keys are not adjacent),
+from tables populated with all the keys.
+Table sizes range from L2 resident (4K keys) to far larger than the
+last level cache (4M keys).
+Threads are pinned to CPUs on Linux, thread counts are powers of 2
+up to the maximum.
+Every operation is timed, latencies are recorded in per thread
+log-linear histograms, so percentiles include the timer overhead and
+are accurate to 1/16th.
+
+usage: bench_solist [milliseconds per run] [max threads] [max keys]
+*/
+#include "solist.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using   benedias::concurrent::solist;
+using   benedias::concurrent::solist_accessor;
+using   benedias::concurrent::hash_mixer_fmix32;
+using   benedias::concurrent::backoff_none;
+
+const   uint32_t key_counts[] = {1u << 12, 1u << 16, 1u << 22};
+
+struct workload
+{
+    const char* name;
+    // Percentage of lookups, the remainder are updates.
+    unsigned    read_percent;
+    bool        insert_only;
+};
+
+const   workload workloads[] = {
+    {"read", 100, false},
+    {"95/5", 95, false},
+    {"50/50", 50, false},
+    {"insert", 0, true},
+};
+
+static inline uint32_t scramble(uint32_t v)
+{
+    return hash_mixer_fmix32::mix(v, 0x9e3779b9);
+}
+
+// xorshift64*, per thread.
+struct bench_rng
+{
+    uint64_t    state;
+    explicit bench_rng(uint64_t seed):state(seed | 1) {}
+
+    inline uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545f4914f6cdd1dull;
+    }
+
+    inline double uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// Zipfian ranks in [0, n), using the method of Gray et al.
+// "Quickly Generating Billion-Record Synthetic Databases", as YCSB does.
+struct zipf_distribution
+{
+    const uint32_t  n;
+    const double    theta;
+    double  alpha;
+    double  zetan;
+    double  eta;
+
+    explicit zipf_distribution(uint32_t n, double theta=0.99):n(n),theta(theta)
+    {
+        double zeta2 = 1.0 + std::pow(0.5, theta);
+        zetan = 0;
+        for (uint32_t i = 1; i <= n; ++i)
+        {
+            zetan += 1.0 / std::pow(double(i), theta);
+        }
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    }
+
+    inline uint32_t operator()(bench_rng& rng) const
+    {
+        double u = rng.uniform();
+        double uz = u * zetan;
+        if (uz < 1.0)
+        {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, theta))
+        {
+            return 1;
+        }
+        uint32_t rank = n * std::pow(eta * u - eta + 1.0, alpha);
+        return rank < n ? rank : n - 1;
+    }
+};
+
+// Log-linear latency histogram, 16 sub buckets per power of 2.
+struct latency_histogram
+{
+    static constexpr unsigned SUB_BITS = 4;
+    static constexpr unsigned SUB = 1u << SUB_BITS;
+    static constexpr unsigned N_BUCKETS = (64 - SUB_BITS + 1) * SUB;
+    std::vector<uint64_t>   counts = std::vector<uint64_t>(N_BUCKETS);
+    uint64_t    total = 0;
+
+    static inline unsigned index(uint64_t ns)
+    {
+        if (ns < SUB)
+        {
+            return ns;
+        }
+        unsigned exp = 63 - __builtin_clzll(ns);
+        return (exp - SUB_BITS + 1) * SUB + ((ns >> (exp - SUB_BITS)) & (SUB - 1));
+    }
+
+    // Lowest value in the bucket.
+    static inline uint64_t value(unsigned ix)
+    {
+        if (ix < SUB)
+        {
+            return ix;
+        }
+        unsigned exp = ix / SUB + SUB_BITS - 1;
+        return (uint64_t(SUB + ix % SUB)) << (exp - SUB_BITS);
+    }
+
+    inline void add(uint64_t ns)
+    {
+        ++counts[index(ns)];
+        ++total;
+    }
+
+    void merge(const latency_histogram& other)
+    {
+        for (unsigned x = 0; x < N_BUCKETS; ++x)
+        {
+            counts[x] += other.counts[x];
+        }
+        total += other.total;
+    }
+
+    uint64_t percentile(double p) const
+    {
+        uint64_t target = std::ceil(total * p);
+        uint64_t sum = 0;
+        for (unsigned x = 0; x < N_BUCKETS; ++x)
+        {
+            sum += counts[x];
+            if (sum >= target && 0 != sum)
+            {
+                return value(x);
+            }
+        }
+        return 0;
+    }
+};
+
+// Baseline, std::unordered_map shards each protected by a mutex.
+class sharded_map
+{
+    static constexpr unsigned N_SHARDS = 64;
+    struct alignas(64) shard
+    {
+        std::mutex  mutex;
+        std::unordered_map<uint32_t, uint32_t> map;
+    };
+    std::unique_ptr<shard[]> shards;
+
+    inline shard& shard_of(uint32_t key)
+    {
+        return shards[hash_mixer_fmix32::mix(key, 0) % N_SHARDS];
+    }
+
+    public:
+    static constexpr const char* name = "sharded_map";
+
+    explicit sharded_map(uint32_t nkeys):shards(new shard[N_SHARDS])
+    {
+        for (unsigned x = 0; x < N_SHARDS; ++x)
+        {
+            shards[x].map.reserve(nkeys / N_SHARDS);
+        }
+    }
+
+    struct handle
+    {
+        sharded_map& owner;
+        explicit handle(sharded_map& m):owner(m) {}
+
+        inline bool find(uint32_t key)
+        {
+            auto& s = owner.shard_of(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return s.map.end() != s.map.find(key);
+        }
+
+        inline bool insert(uint32_t key)
+        {
+            auto& s = owner.shard_of(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return s.map.emplace(key, key).second;
+        }
+
+        inline bool erase(uint32_t key)
+        {
+            auto& s = owner.shard_of(key);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return 0 != s.map.erase(key);
+        }
+    };
+};
+
+class solist_table
+{
+    using list_type = solist<uint32_t, hash_mixer_fmix32, backoff_none>;
+    std::shared_ptr<list_type> sl;
+
+    public:
+    static constexpr const char* name = "solist";
+
+    explicit solist_table(uint32_t nkeys):sl(std::make_shared<list_type>(1024, 4))
+    {
+    }
+
+    struct handle
+    {
+        solist_accessor<uint32_t, hash_mixer_fmix32, backoff_none> sa;
+        explicit handle(solist_table& t):sa(t.sl) {}
+
+        inline bool find(uint32_t key)
+        {
+            bool found = nullptr != sa.find_item_node(key);
+            sa.release();
+            return found;
+        }
+
+        inline bool insert(uint32_t key)
+        {
+            return sa.insert_node(key, key);
+        }
+
+        inline bool erase(uint32_t key)
+        {
+            return sa.delete_node(key);
+        }
+    };
+};
+
+struct run_result
+{
+    double      ops_per_sec;
+    latency_histogram   latency;
+};
+
+static void pin_thread(std::thread& th, unsigned cpu)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu % std::thread::hardware_concurrency(), &cpus);
+    pthread_setaffinity_np(th.native_handle(), sizeof(cpus), &cpus);
+#endif
+}
+
+// The key of the next lookup or update.
+static inline uint32_t next_key(bench_rng& rng, uint32_t nkeys, const zipf_distribution* zipf)
+{
+    if (nullptr == zipf)
+    {
+        return rng.next() % nkeys;
+    }
+    return scramble((*zipf)(rng)) % nkeys;
+}
+
+template <class Table> void bench_thread_fn(Table& table, const workload& wl, uint32_t nkeys,
+        const zipf_distribution* zipf, unsigned id, unsigned num_threads, bool& go, bool& stop,
+        uint64_t& ops, latency_histogram& latency)
+{
+    typename Table::handle h(table);
+    bench_rng rng(0x9e3779b97f4a7c15ull * (id + 1));
+    uint64_t count = 0;
+    // Keys of inserts, unique per thread, the key space is divided
+    // between the threads, whatever their number.
+    uint32_t insert_key = id * (UINT32_MAX / num_threads);
+    while(!__atomic_load_n(&go, __ATOMIC_ACQUIRE))
+    {
+        std::this_thread::yield();
+    }
+    while(!__atomic_load_n(&stop, __ATOMIC_RELAXED))
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (wl.insert_only)
+        {
+            h.insert(scramble(insert_key++));
+        }
+        else
+        {
+            uint32_t key = scramble(next_key(rng, nkeys, zipf));
+            if (rng.next() % 100 < wl.read_percent)
+            {
+                h.find(key);
+            }
+            else if (h.erase(key))
+            {
+                h.insert(key);
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        ++count;
+    }
+    ops = count;
+}
+
+template <class Table> run_result bench_run(Table& table, const workload& wl, uint32_t nkeys,
+        const zipf_distribution* zipf, unsigned num_threads, unsigned millisecs)
+{
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> ops(num_threads);
+    std::vector<latency_histogram> latencies(num_threads);
+    bool go = false;
+    bool stop = false;
+
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        threads.emplace_back(bench_thread_fn<Table>, std::ref(table), std::cref(wl), nkeys,
+                zipf, i, num_threads, std::ref(go), std::ref(stop), std::ref(ops[i]), std::ref(latencies[i]));
+        pin_thread(threads.back(), i);
+    }
+    auto start = std::chrono::steady_clock::now();
+    __atomic_store_n(&go, true, __ATOMIC_RELEASE);
+    std::this_thread::sleep_for(std::chrono::milliseconds(millisecs));
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    for (auto& th: threads)
+    {
+        th.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    run_result result;
+    uint64_t total = 0;
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        total += ops[i];
+        result.latency.merge(latencies[i]);
+    }
+    result.ops_per_sec = total / elapsed.count();
+    return result;
+}
+
+static void report(const char* impl, const char* wl, const char* dist, uint32_t nkeys,
+        unsigned num_threads, const run_result& r)
+{
+    printf("%-12s %-7s %-8s %9u %8u %14.0f %8llu %8llu %8llu\n", impl, wl, dist, nkeys, num_threads,
+            r.ops_per_sec,
+            static_cast<unsigned long long>(r.latency.percentile(0.50)),
+            static_cast<unsigned long long>(r.latency.percentile(0.99)),
+            static_cast<unsigned long long>(r.latency.percentile(0.999)));
+    fflush(stdout);
+}
+
+template <class Table> void bench_table(uint32_t nkeys, const zipf_distribution& zipf,
+        unsigned max_threads, unsigned millisecs)
+{
+    // Lookups and updates share a populated table.
+    Table table(nkeys);
+    {
+        typename Table::handle h(table);
+        for (uint32_t key = 0; key < nkeys; ++key)
+        {
+            h.insert(scramble(key));
+        }
+    }
+    for (auto& wl: workloads)
+    {
+        for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+        {
+            if (wl.insert_only)
+            {
+                Table empty(nkeys);
+                report(Table::name, wl.name, "-", nkeys, num_threads,
+                        bench_run(empty, wl, nkeys, nullptr, num_threads, millisecs));
+                continue;
+            }
+            report(Table::name, wl.name, "uniform", nkeys, num_threads,
+                    bench_run(table, wl, nkeys, nullptr, num_threads, millisecs));
+            report(Table::name, wl.name, "zipf", nkeys, num_threads,
+                    bench_run(table, wl, nkeys, &zipf, num_threads, millisecs));
+        }
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    unsigned millisecs = 200;
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t max_keys = key_counts[sizeof(key_counts)/sizeof(key_counts[0]) - 1];
+    if (argc > 1)
+    {
+        millisecs = strtoul(argv[1], nullptr, 0);
+    }
+    if (argc > 2)
+    {
+        max_threads = strtoul(argv[2], nullptr, 0);
+    }
+    if (argc > 3)
+    {
+        max_keys = strtoul(argv[3], nullptr, 0);
+    }
+    printf("%u ms per run, %u hardware threads, latencies in ns\n",
+            millisecs, std::thread::hardware_concurrency());
+    printf("%-12s %-7s %-8s %9s %8s %14s %8s %8s %8s\n",
+            "table", "mix", "keys", "size", "threads", "ops/s", "p50", "p99", "p999");
+    for (auto nkeys: key_counts)
+    {
+        if (nkeys > max_keys)
+        {
+            break;
+        }
+        zipf_distribution zipf(nkeys);
+        bench_table<solist_table>(nkeys, zipf, max_threads, millisecs);
+        bench_table<sharded_map>(nkeys, zipf, max_threads, millisecs);
+    }
+    return 0;
+}
@@ -19,8 +19,16 @@ Copyright (C) 2018  Blaise Dias
 Simple noddy tests to check my understandings of memory models with atomic
 operations.
 Needs further work, checking in for now so that it doesn't get lost.
+
+usage: castest [bench [iterations]]
+bench compares the costs of mark_ptr_type load orders during traversal,
+and of strong and weak CAS in retry loops. The differences are
+negligible on x86, where loads are acquire and CAS is a full barrier,
+they are on ARM, where acquire loads need barriers and strong CAS
+is a nested LL/SC loop. The bench_castest build is optimised.
 */
 #include "mark_ptr_type.hpp"
+#include <algorithm>
 #include <clocale>
 #include <cstdio>
 #include <cstdlib>
@@ -31,8 +39,10 @@ Needs further work, checking in for now so that it doesn't get lost.
 #include <thread>
 #include <vector>
 #include <chrono>
+#include <cstdint>
 
 using   benedias::concurrent::mark_ptr_type;
+using   benedias::concurrent::tagged_mark_ptr;
 using namespace std::chrono_literals;
 
 struct  B
@@ -135,7 +145,7 @@ void test_0(B& head, test_thread_args& args, Rendezvous& rndvz)
             // introduce contention
             std::this_thread::sleep_for(1ms);
             ++args.cas_count;
-        }while(!head.next.CAS(args.b[x].next(), args.b+x));
+        }while(!head.next.CAS_weak(args.b[x].next(), args.b+x));
     }
     rndvz.end_task();
     while(0 != rndvz.task_count())
@@ -238,11 +248,144 @@ void check_test_1(B& head, std::vector<test_thread_args>& th_args, std::vector<s
 {
 }
 
+// tagged_mark_ptr requires lock free 64 bit atomic operations.
+#if __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+// A CAS against a snapshot fails after the pointer is changed and
+// changed back.
+void check_tagged_mark_ptr()
+{
+    B a, b;
+    tagged_mark_ptr<B> tp(&a);
+    auto stale = tp.load();
+    if (!tp.CAS(tp.load(), &b) || !tp.CAS(tp.load(), &a))
+    {
+        std::cout << "ERROR!!! tagged_mark_ptr CAS failed" << std::endl;
+    }
+    if (tp() != stale.ptr() || tp.CAS(stale, &b))
+    {
+        std::cout << "ERROR!!! tagged_mark_ptr ABA not detected" << std::endl;
+    }
+    if (!tp.mark() || tp.mark() || !tp.load().marked() || tp.load().version() != stale.version() + 3)
+    {
+        std::cout << "ERROR!!! tagged_mark_ptr mark" << std::endl;
+    }
+    // The pointer is unaffected by the version wrapping.
+    for (unsigned x = 0; x < 0x10000; ++x)
+    {
+        tp = &b;
+    }
+    bool marked;
+    if (tp(&marked) != &b || !marked)
+    {
+        std::cout << "ERROR!!! tagged_mark_ptr version wrap" << std::endl;
+    }
+    std::cout << "tagged_mark_ptr checked" << std::endl;
+}
+#endif
+
+// Traverse a list loading next pointers with order.
+double bench_traverse(B* nodes, std::size_t count, unsigned iterations, int order)
+{
+    std::size_t steps = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i)
+    {
+        bool mark;
+        for (B* b = nodes[0].next.load(&mark, order); nullptr != b; b = b->next.load(&mark, order))
+        {
+            ++steps;
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    if (steps != iterations * (count - 1))
+    {
+        std::cout << "ERROR!!! traversal steps " << steps << std::endl;
+    }
+    return elapsed.count() / steps;
+}
+
+// Threads advance a shared word in CAS retry loops.
+// The values are even counts, never dereferenced.
+double bench_cas(unsigned num_threads, unsigned iterations, bool weak, int success)
+{
+    mark_ptr_type<B> word;
+    std::vector<std::thread> threads;
+    bool go = false;
+    auto fn = [&]()
+    {
+        while(!__atomic_load_n(&go, __ATOMIC_ACQUIRE))
+        {
+            std::this_thread::yield();
+        }
+        for (unsigned x = 0; x < iterations; ++x)
+        {
+            B* expected;
+            B* desired;
+            do
+            {
+                expected = word.load(__ATOMIC_RELAXED);
+                desired = reinterpret_cast<B*>(reinterpret_cast<uintptr_t>(expected) + 2);
+            }while(!(weak ? word.CAS_weak(expected, desired, false, success)
+                        : word.CAS(expected, desired, false, success)));
+        }
+    };
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        threads.emplace_back(fn);
+    }
+    auto start = std::chrono::steady_clock::now();
+    __atomic_store_n(&go, true, __ATOMIC_RELEASE);
+    for (auto& th: threads)
+    {
+        th.join();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    if (reinterpret_cast<uintptr_t>(word()) != uintptr_t(2) * num_threads * iterations)
+    {
+        std::cout << "ERROR!!! lost CAS updates" << std::endl;
+    }
+    return elapsed.count() / (num_threads * iterations);
+}
+
+int bench(unsigned iterations)
+{
+    constexpr std::size_t count = 4096;
+    std::vector<B> nodes(count);
+    for (std::size_t x = 0; x + 1 < count; ++x)
+    {
+        nodes[x].next = &nodes[x + 1];
+    }
+    std::cout << "traversal ns/node acquire " << bench_traverse(nodes.data(), count, iterations, __ATOMIC_ACQUIRE)
+        << " relaxed " << bench_traverse(nodes.data(), count, iterations, __ATOMIC_RELAXED)
+        << " seq_cst " << bench_traverse(nodes.data(), count, iterations, __ATOMIC_SEQ_CST)
+        << std::endl;
+
+    unsigned max_threads = std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned n = 1; n <= max_threads; n *= 2)
+    {
+        unsigned cas_iterations = iterations * 1000 / n;
+        std::cout << "threads " << n << " CAS ns/op strong acq_rel "
+            << bench_cas(n, cas_iterations, false, __ATOMIC_ACQ_REL)
+            << " weak acq_rel " << bench_cas(n, cas_iterations, true, __ATOMIC_ACQ_REL)
+            << " weak release " << bench_cas(n, cas_iterations, true, __ATOMIC_RELEASE)
+            << std::endl;
+    }
+    return 0;
+}
+
 int main( int argc, char* argv[] )
 {
     std::setlocale(LC_ALL, "en_US.UTF-8");
     std::srand(std::time(nullptr)); // use current time as seed for random generator
 
+    if (argc > 1 && 0 == std::strcmp(argv[1], "bench"))
+    {
+        return bench(argc > 2 ? std::atoi(argv[2]) : 1000);
+    }
+#if __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+    check_tagged_mark_ptr();
+#endif
+
     std::vector<test_thread_args> th_args;
     std::vector<std::thread> threads;
 
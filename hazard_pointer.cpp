@@ -16,14 +16,166 @@ You should have received a copy of the GNU General Public License
 along with this file.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <mutex>
+#include <new>
 #include "hazard_pointer.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAZPTR_X86_SIMD 1
+#endif
+#if defined(__linux__) && !defined(HAZPTR_NO_MEMBARRIER)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAZPTR_MEMBARRIER 1
+#endif
+#if defined(__linux__) && !defined(HAZPTR_NO_PERCPU)
+#include <sched.h>
+#define HAZPTR_PERCPU 1
+#endif
 
 namespace benedias {
     namespace concurrent {
 
+// Batch membership kernels, see hazptr_batch_search.
+typedef void (*batch_search_fn)(const generic_hazptr_t* values, std::size_t nvalues,
+                const generic_hazptr_t* items, std::size_t nitems, bool* found);
+
+void hazptr_batch_search_scalar(const generic_hazptr_t* values, std::size_t nvalues,
+        const generic_hazptr_t* items, std::size_t nitems, bool* found)
+{
+    for(std::size_t ix = 0; ix < nitems; ++ix)
+    {
+        // Branch free.
+        bool hit = false;
+        for(std::size_t v = 0; v < nvalues; ++v)
+        {
+            hit |= (values[v] == items[ix]);
+        }
+        found[ix] = hit;
+    }
+}
+
+#ifdef HAZPTR_X86_SIMD
+__attribute__((target("avx2")))
+static void batch_search_avx2(const generic_hazptr_t* values, std::size_t nvalues,
+        const generic_hazptr_t* items, std::size_t nitems, bool* found)
+{
+    constexpr std::size_t lanes = sizeof(__m256i) / sizeof(generic_hazptr_t);
+    const std::size_t nvec = nvalues - (nvalues % lanes);
+    for(std::size_t ix = 0; ix < nitems; ++ix)
+    {
+        uintptr_t item = reinterpret_cast<uintptr_t>(items[ix]);
+        __m256i key = sizeof(uintptr_t) == 8 ?
+            _mm256_set1_epi64x(item) : _mm256_set1_epi32(item);
+        __m256i acc = _mm256_setzero_si256();
+        for(std::size_t v = 0; v < nvec; v += lanes)
+        {
+            __m256i vals = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + v));
+            acc = _mm256_or_si256(acc, sizeof(uintptr_t) == 8 ?
+                    _mm256_cmpeq_epi64(vals, key) : _mm256_cmpeq_epi32(vals, key));
+        }
+        bool hit = !_mm256_testz_si256(acc, acc);
+        for(std::size_t v = nvec; v < nvalues; ++v)
+        {
+            hit |= (values[v] == items[ix]);
+        }
+        found[ix] = hit;
+    }
+}
+
+__attribute__((target("sse2")))
+static void batch_search_sse2(const generic_hazptr_t* values, std::size_t nvalues,
+        const generic_hazptr_t* items, std::size_t nitems, bool* found)
+{
+    constexpr std::size_t lanes = sizeof(__m128i) / sizeof(generic_hazptr_t);
+    const std::size_t nvec = nvalues - (nvalues % lanes);
+    for(std::size_t ix = 0; ix < nitems; ++ix)
+    {
+        uintptr_t item = reinterpret_cast<uintptr_t>(items[ix]);
+        __m128i key = sizeof(uintptr_t) == 8 ?
+            _mm_set1_epi64x(item) : _mm_set1_epi32(item);
+        __m128i acc = _mm_setzero_si128();
+        for(std::size_t v = 0; v < nvec; v += lanes)
+        {
+            __m128i vals = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + v));
+            __m128i eq = _mm_cmpeq_epi32(vals, key);
+            if (sizeof(uintptr_t) == 8)
+            {
+                // SSE2 has no 64 bit compare, both halves must match.
+                eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2,3,0,1)));
+            }
+            acc = _mm_or_si128(acc, eq);
+        }
+        bool hit = 0 != _mm_movemask_epi8(acc);
+        for(std::size_t v = nvec; v < nvalues; ++v)
+        {
+            hit |= (values[v] == items[ix]);
+        }
+        found[ix] = hit;
+    }
+}
+#endif
+
+static batch_search_fn batch_search_impl = hazptr_batch_search_scalar;
+static const char* batch_search_name = "scalar";
+
+void hazptr_batch_search(const generic_hazptr_t* values, std::size_t nvalues,
+        const generic_hazptr_t* items, std::size_t nitems, bool* found)
+{
+    batch_search_impl(values, nvalues, items, nitems, found);
+}
+
+const char* hazptr_batch_search_isa()
+{
+    return batch_search_name;
+}
+
+bool hazptr_asymmetric_fences = false;
+
+void hazptr_scan_fence()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#ifdef HAZPTR_MEMBARRIER
+    if (__atomic_load_n(&hazptr_asymmetric_fences, __ATOMIC_RELAXED))
+    {
+        // Cannot fail once registered.
+        long rv = syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+        assert(0 == rv);
+        (void)rv;
+    }
+#endif
+}
+
+static void initialise_fences()
+{
+#ifdef HAZPTR_MEMBARRIER
+    // Registration is required before using the private expedited command.
+    long cmds = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0, 0);
+    if (cmds > 0 && 0 != (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+            && 0 == syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0))
+    {
+        __atomic_store_n(&hazptr_asymmetric_fences, true, __ATOMIC_RELEASE);
+    }
+#endif
+}
+
 static std::once_flag   init_flag;
 static void initialise()
 {
+    initialise_fences();
+#ifdef HAZPTR_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        batch_search_impl = batch_search_avx2;
+        batch_search_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        batch_search_impl = batch_search_sse2;
+        batch_search_name = "sse2";
+    }
+#endif
 }
 
 void hazard_pointer_global_init()
@@ -39,132 +191,253 @@ void hazard_pointer_global_init()
     }
 }
 
+// hazptr_free_stack and hazptr_size_class member functions
+        // Free stack heads pack a block pointer and a tag into 64 bits,
+        // on 64 bit targets user space addresses fit in the low 48 bits.
+#if UINTPTR_MAX == UINT64_MAX
+        static constexpr unsigned free_tag_shift = 48;
+#else
+        static constexpr unsigned free_tag_shift = 32;
+#endif
+        static constexpr uint64_t free_ptr_mask = (uint64_t(1) << free_tag_shift) - 1;
+
+        static inline hazptr_block* free_ptr(uint64_t head)
+        {
+            return reinterpret_cast<hazptr_block*>(static_cast<uintptr_t>(head & free_ptr_mask));
+        }
+
+        static inline uint64_t free_next_head(uint64_t head, hazptr_block* blk)
+        {
+            uint64_t tag = (head >> free_tag_shift) + 1;
+            assert(0 == (reinterpret_cast<uintptr_t>(blk) & ~free_ptr_mask));
+            return (tag << free_tag_shift) | reinterpret_cast<uintptr_t>(blk);
+        }
+
+        hazptr_block* hazptr_free_stack::pop()
+        {
+            uint64_t head = __atomic_load_n(&this->head, __ATOMIC_ACQUIRE);
+            while(nullptr != free_ptr(head))
+            {
+                hazptr_block* blk = free_ptr(head);
+                // Blocks are not freed before the domain, so reading the
+                // link of a block popped concurrently is safe, the tag
+                // makes the CAS fail in that case.
+                hazptr_block* next = __atomic_load_n(&blk->next_free, __ATOMIC_RELAXED);
+                if (__atomic_compare_exchange_n(&this->head, &head, free_next_head(head, next),
+                            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    return blk;
+                }
+            }
+            return nullptr;
+        }
+
+        void hazptr_free_stack::push(hazptr_block* first, hazptr_block* last)
+        {
+            uint64_t head = __atomic_load_n(&this->head, __ATOMIC_RELAXED);
+            do
+            {
+                __atomic_store_n(&last->next_free, free_ptr(head), __ATOMIC_RELAXED);
+            }while(!__atomic_compare_exchange_n(&this->head, &head, free_next_head(head, first),
+                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        }
+
+        // Upper limit on the number of per CPU free stacks of a size class,
+        // CPUs share stacks beyond this.
+        static constexpr unsigned max_cpu_stacks = 64;
+
+        static unsigned cpu_stack_count()
+        {
+#ifdef HAZPTR_PERCPU
+            unsigned ncpus = std::thread::hardware_concurrency();
+            return ncpus == 0 ? 1 : std::min(ncpus, max_cpu_stacks);
+#else
+            return 1;
+#endif
+        }
+
+        // Index of the CPU the calling thread is running on,
+        // sched_getcpu is serviced by rseq or the vDSO, without a system call.
+        static inline unsigned current_cpu()
+        {
+#ifdef HAZPTR_PERCPU
+            int cpu = sched_getcpu();
+            return cpu < 0 ? 0 : cpu;
+#else
+            return 0;
+#endif
+        }
+
+        hazptr_size_class::hazptr_size_class(std::size_t blocksize)
+            :blk_size(blocksize),nstacks(cpu_stack_count()),
+            stacks(new hazptr_free_stack[nstacks])
+        {
+        }
+
+        hazptr_block* hazptr_size_class::pop()
+        {
+            unsigned cpu = current_cpu() % nstacks;
+            hazptr_block* blk = stacks[cpu].pop();
+            // Take a block from another CPU rather than create a pool.
+            for(unsigned x = 1; nullptr == blk && x < nstacks; ++x)
+            {
+                blk = stacks[(cpu + x) % nstacks].pop();
+            }
+            return blk;
+        }
+
+        void hazptr_size_class::push(hazptr_block* first, hazptr_block* last)
+        {
+            stacks[current_cpu() % nstacks].push(first, last);
+        }
+
 // hazptr_pool member functions
-        hazptr_pool::hazptr_pool(std::size_t blocksize):blk_size(blocksize),hp_count(blocksize * HAZPTR_POOL_BLOCKS)
+        hazptr_pool::hazptr_pool(hazptr_size_class* sclass)
+            :blk_size(sclass->blk_size),hp_count(sclass->blk_size * HAZPTR_POOL_BLOCKS),
+            stride((sizeof(hazptr_block) + sclass->blk_size * sizeof(generic_hazptr_t)
+                        + HAZPTR_CACHE_LINE - 1) & ~(HAZPTR_CACHE_LINE - 1)),
+            size_class(sclass)
         {
+            static_assert(0 == sizeof(hazptr_block) % alignof(generic_hazptr_t),
+                    "hazard pointers must be aligned after the block header");
             // This allocation can be blocking, it will be called as part of the 
             // setup for hazard_pointer_context.
-            haz_ptrs = new generic_hazptr_t[hp_count];
-            std::fill(haz_ptrs, haz_ptrs + hp_count, nullptr);
+            storage = static_cast<unsigned char*>(::operator new[](stride * HAZPTR_POOL_BLOCKS,
+                        std::align_val_t(HAZPTR_CACHE_LINE)));
+            for(std::size_t ix = 0; ix < HAZPTR_POOL_BLOCKS; ++ix)
+            {
+                hazptr_block* blk = new(storage + ix * stride) hazptr_block(this, ix);
+                std::fill(blk->hazard_pointers(), blk->hazard_pointers() + blk_size, nullptr);
+            }
         }        
 
         hazptr_pool::~hazptr_pool()
         {
-            delete [] haz_ptrs;
+            // hazptr_block and the hazard pointers are trivially destructible.
+            ::operator delete[](storage, std::align_val_t(HAZPTR_CACHE_LINE));
         }
 
         std::size_t hazptr_pool::copy_hazard_pointers(generic_hazptr_t *dest, std::size_t count) const
         {
             //copy must be of the whole pool
             assert(count >= hp_count);
-#if 0
-#if 0
-            std::copy(haz_ptrs, haz_ptrs + hp_count, dest);
-            return hp_count;
-#else
-            generic_hazptr_t *dest_end
-                = std::copy_if(haz_ptrs, haz_ptrs + hp_count, dest,
-                        [](generic_hazptr_t sp){return nullptr !=sp;});
-            return dest_end - dest;
-#endif
-#endif
             std::size_t ix_dst = 0;
-            for(std::size_t ix_src = 0; ix_src < hp_count; ++ix_src)
+            for(std::size_t ix_blk = 0; ix_blk < HAZPTR_POOL_BLOCKS; ++ix_blk)
             {
-                generic_hazptr_t p = __atomic_load_n(haz_ptrs + ix_src, __ATOMIC_ACQUIRE);
-                if (nullptr != p)
+                generic_hazptr_t* haz_ptrs = block(ix_blk)->hazard_pointers();
+                for(std::size_t ix_src = 0; ix_src < blk_size; ++ix_src)
                 {
-                    dest[ix_dst] = p;
-                    ++ix_dst;
+                    generic_hazptr_t p = __atomic_load_n(haz_ptrs + ix_src, __ATOMIC_ACQUIRE);
+                    if (nullptr != p)
+                    {
+                        dest[ix_dst] = p;
+                        ++ix_dst;
+                    }
                 }
             }
             return ix_dst;
         }
 
-        generic_hazptr_t* hazptr_pool::reserve_impl(std::size_t len)
+        hazptr_block* hazptr_pool::reserve_impl()
         {
-            uint32_t    mask=1;
-            uint32_t    ix=0;
-            generic_hazptr_t*  reserved = nullptr;
-            uint32_t    expected = bitmap;
-
-            if (len != blk_size)
-                return nullptr;
-            while (expected != HAZPTR_POOL_BITMAP_FULL && nullptr == reserved)
-            {
-                mask = 1;
-                ix = 0;
-                while (0 != (expected & mask) && ix < HAZPTR_POOL_BLOCKS)
+            uint64_t    expected = __atomic_load_n(&bitmap, __ATOMIC_RELAXED);
+            while (expected != HAZPTR_POOL_BITMAP_FULL)
+            {
+                unsigned ix = __builtin_ctzll(~expected);
+                uint64_t desired = expected | (uint64_t(1) << ix);
+                if(__atomic_compare_exchange_n(&bitmap, &expected, desired,
+                        false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
                 {
-                    mask <<= 1;
-                    ++ix;
+                    return block(ix);
                 }
+                // CAS failed, so expected will have been updated to the new value
+                // of bitmap.
+            }
+            return nullptr;
+        }
 
-                if (ix < HAZPTR_POOL_BLOCKS)
+        hazptr_block* hazptr_pool::free_chain(hazptr_block** first) const
+        {
+            hazptr_block* last = nullptr;
+            *first = nullptr;
+            for(uint64_t free = ~__atomic_load_n(&bitmap, __ATOMIC_ACQUIRE); 0 != free; free &= free - 1)
+            {
+                hazptr_block* blk = block(__builtin_ctzll(free));
+                if (nullptr == last)
                 {
-                    uint32_t desired = expected | mask;
-                    if(__atomic_compare_exchange(&bitmap, &expected, &desired,
-                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
-                    {
-                        reserved = &haz_ptrs[ix * blk_size];
-                    }
-                    else
-                    {
-                        // CAS failed, so expected will have been updated to the new value
-                        // of bitmap.
-                    }
+                    *first = blk;
                 }
+                else
+                {
+                    last->next_free = blk;
+                }
+                last = blk;
             }
+            return last;
+        }
 
-            return reserved;
+        void hazptr_pool::reserved(hazptr_block* blk)
+        {
+            uint64_t mask = uint64_t(1) << blk->index;
+            uint64_t prev = __atomic_fetch_or(&bitmap, mask, __ATOMIC_ACQ_REL);
+            assert(0 == (prev & mask));
+            (void)prev;
         }
 
-        /// lock-free thread safe release of blocks of pointers.
-        /// The pointers are only "released" if supplied pointer is to a
-        /// block of hazard pointers contained in this pool.
-        /// \@param pointer to the first hazard pointer in the block.
-        /// \@return true if hazard pointers were released, false otherwise.
-        bool hazptr_pool::release_impl(generic_hazptr_t* ptr)
+        void hazptr_pool::release_impl(hazptr_block* blk)
         {
-            // To facilitate clients walking down a list of hazard pointer
-            // pools and invoking release until the correct pool instance
-            // actually releases the block, check address range, return
-            // false if the block does not belong to this pool instance.
-            if (ptr < &haz_ptrs[0] || ptr >= &haz_ptrs[hp_count])
-                return false;
-
-            uint32_t    mask=1;
+            assert(this == blk->pool);
+            generic_hazptr_t* ptr = blk->hazard_pointers();
             for(std::size_t x = 0; x < blk_size; x++)
             {
                 if (nullptr != *(ptr +x)) 
                     __atomic_store_n(ptr + x, 0x0, __ATOMIC_RELEASE);
             }
-            for(std::size_t ix = 0; ix < HAZPTR_POOL_BLOCKS; ++ix)
-            {
-                if(ptr == &haz_ptrs[ix * blk_size])
-                {
-                    assert(mask == (bitmap & mask));
-                    uint32_t    expected, desired;
-                    do
-                    {
-                        expected = bitmap;
-                        desired = expected ^ mask;
-                    }while(!__atomic_compare_exchange(&bitmap, &expected, &desired,
-                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
-                    break;
-                }
-                mask <<= 1;
-            }
-
-            return true;
+            uint64_t mask = uint64_t(1) << blk->index;
+            uint64_t prev = __atomic_fetch_and(&bitmap, ~mask, __ATOMIC_ACQ_REL);
+            assert(mask == (prev & mask));
+            (void)prev;
         }
 
 // hazptrs_snapshot member functions.
+        // Per thread storage for snapshots, reused so that scans do not
+        // allocate, unless the number of hazard pointers has grown.
+        // Trivially destructible, so that it remains valid while other
+        // thread local objects are destroyed, the storage is freed by
+        // hazptrs_snapshot_buffer_guard.
+        struct hazptrs_snapshot_buffer
+        {
+            generic_hazptr_t* values;
+            std::size_t capacity;
+            bool in_use;
+            // Set once the storage is freed at thread exit, snapshots
+            // taken by thread local objects destroyed later fall back
+            // to the heap.
+            bool released;
+        };
+        static thread_local hazptrs_snapshot_buffer snapshot_buffer = {nullptr, 0, false, false};
+
+        // Frees the snapshot storage of a thread when it exits,
+        // instantiated by the first snapshot using the storage.
+        struct hazptrs_snapshot_buffer_guard
+        {
+            ~hazptrs_snapshot_buffer_guard()
+            {
+                delete [] snapshot_buffer.values;
+                snapshot_buffer.values = nullptr;
+                snapshot_buffer.capacity = 0;
+                snapshot_buffer.released = true;
+            }
+        };
+        static thread_local hazptrs_snapshot_buffer_guard snapshot_buffer_guard;
+
         void hazptrs_snapshot::reset()
         {
-            ptrvalues = begin = end = nullptr;
+            ptrvalues = begin = end = table = nullptr;
+            table_mask = 0;
             size = 0;
             pools = nullptr;
+            buffer_in_use = nullptr;
         }
 
         // Partially movable
@@ -174,7 +447,10 @@ void hazard_pointer_global_init()
             ptrvalues = std::move(other.ptrvalues);
             begin = std::move(other.begin);
             end = std::move(other.end);
+            table = std::move(other.table);
+            table_mask = std::move(other.table_mask);
             size = std::move(other.size);
+            buffer_in_use = std::move(other.buffer_in_use);
             other.reset();
         }
 
@@ -192,10 +468,46 @@ void hazard_pointer_global_init()
             {
                 size += p->count();
             }
-            //FIXME: use lockless allocator, especially for inline
-            // collect cycles. If collection is restricted to a thread
-            // dedicated for that purpose then we can use the std allocator.
-            ptrvalues = new generic_hazptr_t[size];
+
+            // Hazard pointers published by readers before this point
+            // must be visible in the copy.
+            hazptr_scan_fence();
+
+            // Space for the values, followed by a hash set at most half full.
+            std::size_t table_size = 0;
+            if (size > HAZPTR_SNAPSHOT_LINEAR_MAX)
+            {
+                table_size = 1;
+                while (table_size < size * 2)
+                {
+                    table_size <<= 1;
+                }
+            }
+            std::size_t required = size + table_size;
+
+            generic_hazptr_t* storage;
+            if (!snapshot_buffer.in_use && !snapshot_buffer.released)
+            {
+                if (snapshot_buffer.capacity < required)
+                {
+                    // Register freeing the storage at thread exit.
+                    (void)&snapshot_buffer_guard;
+                    delete [] snapshot_buffer.values;
+                    snapshot_buffer.values = new generic_hazptr_t[required];
+                    snapshot_buffer.capacity = required;
+                }
+                snapshot_buffer.in_use = true;
+                buffer_in_use = &snapshot_buffer.in_use;
+                storage = snapshot_buffer.values;
+            }
+            else
+            {
+                // Nested snapshot, for example a domain collect triggered
+                // while a context is reclaiming.
+                ptrvalues = new generic_hazptr_t[required];
+                storage = ptrvalues;
+            }
+
             // Then copy that number of pointers from the pools,
             // if new pools have been added since the snapshot of the count,
             // those values cannot be of interest in the snapshot *because*
@@ -203,41 +515,37 @@ void hazard_pointer_global_init()
             std::size_t count = 0;
             for(auto p = pools; nullptr != p; p = p->next)
             {
-                count += p->copy_hazard_pointers(ptrvalues + count, p->count());
+                count += p->copy_hazard_pointers(storage + count, p->count());
             }
             assert(count <= size);
-            end = ptrvalues + count;
-            begin = ptrvalues;
-            std::sort(begin, end);
-#if 0
-            // move begin to the last entry with a nullptr value
-            // if it exists.
-            // variation on binary search.
-            do
+            end = storage + count;
+            begin = storage;
+            // Mark bits are stripped before publication
+            // (see hazptr_protect_traits), so values are used as is.
+
+            if (count > HAZPTR_SNAPSHOT_LINEAR_MAX)
             {
-                std::size_t halfc = count >> 1;
-                if(begin[halfc] == nullptr)
-                {
-                    begin += halfc;
-                    count -= halfc;
-                }
-                else
+                table = storage + size;
+                table_mask = table_size - 1;
+                std::fill(table, table + table_size, nullptr);
+                for(auto p = begin; p < end; ++p)
                 {
-                    count = halfc;
+                    std::size_t ix = hash(*p) & table_mask;
+                    while(nullptr != table[ix] && *p != table[ix])
+                    {
+                        ix = (ix + 1) & table_mask;
+                    }
+                    table[ix] = *p;
                 }
-            }while(count > 1);
-#endif
-            /// TODO: only if underlying type is an instance of mark_ptr_type
-            for(uintptr_t* p = reinterpret_cast<uintptr_t*>(begin);
-                    p < reinterpret_cast<uintptr_t*>(end);
-                    ++p)
-            {
-                *p &= mark_bits_maskoff;
             }
         }
 
         hazptrs_snapshot::~hazptrs_snapshot()
         {
+            if (nullptr != buffer_in_use)
+            {
+                *buffer_in_use = false;
+            }
             if (nullptr != ptrvalues)
             {
                 delete [] ptrvalues;
@@ -245,59 +553,65 @@ void hazard_pointer_global_init()
         }
 
 //hazptr_domain member functions
-            /// For lock-free operation, we push new hazard pointer pools
-            /// to head of the list (pool) atomically.
-            /// Note that allocation of the hazptr pool may block,
-            /// but that will not affect concurrent operations.
-            void hazptr_domain::pools_new(hazptr_pool** phead, std::size_t blocklen)
+            /// Find or create the size class for a block length, lock-free.
+            /// Classes are pushed onto the head of the list, so if the push
+            /// fails only the newly added classes need to be searched.
+            hazptr_size_class* hazptr_domain::size_class(std::size_t blocklen)
             {
-                hazptr_pool* pool = new hazptr_pool(blocklen);
-                do
+                auto find = [blocklen](hazptr_size_class* from, hazptr_size_class* to)
                 {
-                    pool->next = *phead;
-                }while(!__atomic_compare_exchange(phead, &pool->next, &pool,
-                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
-                hp_count += pool->count(); 
-            }
-
-            /// Attempt to fulfil a reservation request by requesting
-            /// a block from with the set of hazard pointer pools.
-            /// Reserving hazard pointers is "expensive",
-            /// and occurs at hazard pointer context creation.
-            /// This performance hit can be amortised using a lock free pool
-            /// or cache, of hazard pointer contexts, this will increase memory
-            /// usage.
-            /// \@param head - start of pool of hazard pointer pools.
-            /// \@param blocklen - number of hazard pointers required
-            /// \@return - nullptr or pointer to the block of hazard pointers.
-            generic_hazptr_t* hazptr_domain::pools_reserve(hazptr_pool* head, std::size_t blocklen)
-            {
-                generic_hazptr_t* reservation = nullptr;
-                for(auto p = head; nullptr != p && nullptr == reservation; )
+                    for(auto c = from; to != c; c = c->next)
+                    {
+                        if (blocklen == c->blk_size)
+                            return c;
+                    }
+                    return static_cast<hazptr_size_class*>(nullptr);
+                };
+                hazptr_size_class* head = __atomic_load_n(&classes_head, __ATOMIC_ACQUIRE);
+                hazptr_size_class* sclass = find(head, nullptr);
+                if (nullptr != sclass)
+                    return sclass;
+
+                sclass = new hazptr_size_class(blocklen);
+                sclass->next = head;
+                while(!__atomic_compare_exchange_n(&classes_head, &sclass->next, sclass,
+                            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
                 {
-                    reservation = p->reserve_impl(blocklen);
+                    hazptr_size_class* other = find(sclass->next, head);
+                    if (nullptr != other)
+                    {
+                        delete sclass;
+                        return other;
+                    }
+                    head = sclass->next;
                 }
-                return reservation;
+                return sclass;
             }
 
-            /// Release previously reserved hazard pointer reservations.
-            /// Releasing hazard pointers is "expensive",
-            /// and occurs at hazard pointer context creation.
-            /// This performance hit can be amortised using a lock free pool
-            /// or cache, of hazard pointer contexts, this will increase memory
-            /// usage.
-            /// \@param head - pointer to list of hazard pointer blocks.
-            /// \@param ptr - hazard pointer block to be released.
-            bool hazptr_domain::pools_release(hazptr_pool* head, generic_hazptr_t* ptr)
+            /// For lock-free operation, we push new hazard pointer pools
+            /// to head of the list (pool) atomically.
+            /// Note that allocation of the hazptr pool may block,
+            /// but that will not affect concurrent operations.
+            hazptr_block* hazptr_domain::pools_new(hazptr_size_class* sclass)
             {
-                bool released = false;
-                for(auto p = head; nullptr != p && !released; )
+                hazptr_pool* pool = new hazptr_pool(sclass);
+                // The pool is not yet visible, reserve a block for the caller
+                // and make the rest available to other threads.
+                hazptr_block* reservation = pool->reserve_impl();
+                hazptr_block* first;
+                hazptr_block* last = pool->free_chain(&first);
+
+                pool->next = __atomic_load_n(&pools_head, __ATOMIC_RELAXED);
+                while(!__atomic_compare_exchange_n(&pools_head, &pool->next, pool,
+                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
                 {
-                    auto pnext = p->next;
-                    released = p->release_impl(ptr);
-                    p = pnext;
                 }
-                return released;
+                __atomic_add_fetch(&hp_count, pool->count(), __ATOMIC_RELAXED);
+                if (nullptr != last)
+                {
+                    sclass->push(first, last);
+                }
+                return reservation;
             }
 
             /// Since the instances of domain pointers are only accessible, 
@@ -326,6 +640,13 @@ void hazard_pointer_global_init()
                     delete p;
                     p = pnext;
                 }
+                for(hazptr_size_class* c = __atomic_exchange_n(
+                        &classes_head, nullptr,  __ATOMIC_ACQ_REL); nullptr != c; )
+                {
+                    auto cnext = c->next;
+                    delete c;
+                    c = cnext;
+                }
             }
 
             /// Push a delete node onto the delete list, lock free and wait free.
@@ -341,7 +662,13 @@ void hazard_pointer_global_init()
                 }
                 while(!__atomic_compare_exchange(&delete_head, &del_node->next, &desired,
                             false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
-                __atomic_add_fetch(&delete_count, 1, __ATOMIC_RELEASE);
+            }
+
+            std::shared_ptr<hazptr_domain> hazptr_domain::global()
+            {
+                // Lives until the last container using it has been destroyed.
+                static std::shared_ptr<hazptr_domain> domain = make();
+                return domain;
             }
 
             /// Fulfill a reservation request using the set of hazard pointer pools
@@ -349,14 +676,31 @@ void hazard_pointer_global_init()
             /// \@param blocklen - the number of hazard pointers required.
             generic_hazptr_t* hazptr_domain::reserve(std::size_t blocklen)
             {
-                generic_hazptr_t* reservation = pools_reserve(pools_head, blocklen);
-                if (nullptr == reservation)
+                hazptr_size_class* sclass = size_class(blocklen);
+                hazptr_block* reservation = sclass->pop();
+                if (nullptr != reservation)
                 {
-                    pools_new(&pools_head, blocklen);
-                    reservation = pools_reserve(pools_head, blocklen);
+                    reservation->pool->reserved(reservation);
+                }
+                else
+                {
+                    reservation = pools_new(sclass);
                 }
                 assert(nullptr != reservation);
-                return reservation;
+                __atomic_add_fetch(&hp_reserved, blocklen, __ATOMIC_RELAXED);
+                return reservation->hazard_pointers();
+            }
+
+            /// Release hazard pointers previously reserved,
+            /// lock-free and constant time.
+            void hazptr_domain::release(generic_hazptr_t* hps, std::size_t blocklen)
+            {
+                hazptr_block* blk = hazptr_block::from_hazard_pointers(hps);
+                hazptr_pool* pool = blk->pool;
+                assert(blocklen == pool->size_class->blk_size);
+                pool->release_impl(blk);
+                pool->size_class->push(blk, blk);
+                __atomic_sub_fetch(&hp_reserved, blocklen, __ATOMIC_RELAXED);
             }
 
             /// Add a pointer to the delete list.
@@ -386,30 +730,6 @@ void hazard_pointer_global_init()
                 }
             }
 
-            void hazptr_domain::collect_if_required()
-            {
-                bool do_collect = false;
-
-                while (delete_count > hp_count)
-                {
-                    int dc = delete_count;
-                    do_collect =  __atomic_compare_exchange_n(
-                            &delete_count, &dc, 0,
-                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
-                    // zero the delete count to reduce triggering multiple concurrent
-                    // collect cycles.
-                    // preemptive scheduling means that it is possible,
-                    // that multiple threads enter collect cycles concurrently,
-                    // because the check and clearing of the delete counter
-                    // are not atomic. 
-                    // Multiple collect cycles can be run concurrently without compromising
-                    // integrity, but this would be more expensive than it should be.
-                }
-
-                if (do_collect)
-                    collect();
-            }
-
             /// Delete objects on the delete list if no live pointers to
             /// those objects exist.
             /// Serialising the execution of this function, is not required,
@@ -428,8 +748,7 @@ void hazard_pointer_global_init()
                 if (nullptr == local_delete_head)
                 {
                     // This can happen in the event that collect cycles were
-                    // triggered concurrently on different thread, because
-                    // the check and clear on the delete count is not atomic.
+                    // triggered concurrently on different threads.
                     return;
                 }
 
@@ -443,6 +762,7 @@ void hazard_pointer_global_init()
                 }
                 pprev = &local_delete_head;
                 hazptrs_snapshot  hps(pools_head);
+                hazp_delete_node* reclaimable = nullptr;
                 while(nullptr != *pprev)
                 {
                     hazp_delete_node* cur = *pprev;
@@ -450,8 +770,8 @@ void hazard_pointer_global_init()
                     {
                         // delink
                         *pprev = cur->next;
-                        cur->reclaimer.reclaim_object(cur->payload);
-                        delete cur;
+                        cur->next = reclaimable;
+                        reclaimable = cur;
                     }
                     else
                     {
@@ -460,12 +780,113 @@ void hazard_pointer_global_init()
                     }
                 }
 
-                // put nodes that could not be deleted back on the shared list.
-                while(nullptr != local_delete_head)
+                // Reclaim grouped by reclaimer, with one call per batch of
+                // objects. The last batch of a reclaimer may release its
+                // domain (see hazard_pointer_domain::reclaim_batch), so
+                // the reclaimer is not used after that.
+                generic_hazptr_t batch[HAZPTR_RECLAIM_BATCH];
+                while(nullptr != reclaimable)
+                {
+                    domain_reclaimer* reclaimer = &reclaimable->reclaimer;
+                    std::size_t count = 0;
+                    for(hazp_delete_node** pp = &reclaimable; nullptr != *pp; )
+                    {
+                        hazp_delete_node* cur = *pp;
+                        if (&cur->reclaimer == reclaimer)
+                        {
+                            *pp = cur->next;
+                            batch[count++] = cur->payload;
+                            delete cur;
+                            if (HAZPTR_RECLAIM_BATCH == count)
+                            {
+                                reclaimer->reclaim_batch(batch, count);
+                                count = 0;
+                            }
+                        }
+                        else
+                        {
+                            pp = &cur->next;
+                        }
+                    }
+                    if (0 != count)
+                    {
+                        reclaimer->reclaim_batch(batch, count);
+                    }
+                }
+
+                // put nodes that could not be deleted back on the shared list,
+                // as a single chain.
+                if (nullptr != local_delete_head)
+                {
+                    hazp_delete_node* last = local_delete_head;
+                    while(nullptr != last->next)
+                    {
+                        last = last->next;
+                    }
+                    last->next = __atomic_load_n(&delete_head, __ATOMIC_RELAXED);
+                    while(!__atomic_compare_exchange_n(&delete_head, &last->next, local_delete_head,
+                                false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                    {
+                    }
+                }
+            }
+
+//hazptr_reclaimer member functions
+            hazptr_reclaimer::hazptr_reclaimer(std::chrono::milliseconds period):period(period)
+            {
+                worker = std::thread(&hazptr_reclaimer::run, this);
+            }
+
+            hazptr_reclaimer::~hazptr_reclaimer()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+                cv.notify_all();
+                worker.join();
+                // Domains hold references to the reclaimer, so none
+                // can be attached.
+                assert(domains.empty());
+            }
+
+            std::shared_ptr<hazptr_reclaimer> hazptr_reclaimer::make(std::chrono::milliseconds period)
+            {
+                return std::shared_ptr<hazptr_reclaimer>(new hazptr_reclaimer(period));
+            }
+
+            void hazptr_reclaimer::attach(domain_reclaimer* domain)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                domains.push_back(domain);
+            }
+
+            void hazptr_reclaimer::detach(domain_reclaimer* domain)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                domains.erase(std::remove(domains.begin(), domains.end(), domain), domains.end());
+            }
+
+            void hazptr_reclaimer::request()
+            {
+                if (!__atomic_exchange_n(&requested, true, __ATOMIC_ACQ_REL))
+                {
+                    cv.notify_one();
+                }
+            }
+
+            void hazptr_reclaimer::run()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while(!stop)
                 {
-                    auto del_entry = local_delete_head;
-                    local_delete_head = local_delete_head->next;
-                    push_delete_node(del_entry);
+                    cv.wait_for(lock, period,
+                            [this]{ return stop || __atomic_load_n(&requested, __ATOMIC_ACQUIRE);});
+                    __atomic_store_n(&requested, false, __ATOMIC_RELEASE);
+                    for(auto domain: domains)
+                    {
+                        domain->collect();
+                    }
                 }
             }
     }
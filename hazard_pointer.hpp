@@ -24,8 +24,14 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 #include <cstring>
 #include <cstdlib>
 #include <utility>
+#include <type_traits>
 #include <memory>
 #include <algorithm>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 #include "mark_ptr_type.hpp"
 
 #if 0
@@ -65,29 +71,24 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 ///  objective is to make code accessing the containers similar if not identical to
 ///  standard containers.
 ///
-///  Deleted items are "queued" in the hazard_pointer_context in an array of
-///  fixed size.
-///  The pathological case where the number of items deleted exceeds the 
-///  delete array size, and none can be deleted due to liveness, is handled by queueing
-///  deletions onto the domain delete list, memory is allocated to queue the deletion,
-///  which can result in blocking.
+///  Deleted items are "queued" in the hazard_pointer_context, on a list private to
+///  the context, which is scanned when its length reaches max(R, k.H), where H is
+///  the current number of hazard pointers in the domain (Michael's adaptive scheme).
+///  At most H items survive a scan, so the amortised cost of reclamation per item
+///  is constant, independent of the number of threads.
+///  Items which survive a scan remain on the context's list.
+///
+///  Only when a hazard_pointer_context is destroyed are its remaining deletions
+///  queued onto the domain delete list, memory is allocated to queue the deletion,
+///  which can result in blocking. The domain delete list is collected by
+///  subsequent scans of any context, and on destruction of the domain.
 ///
 ///  The tradeoffs 
-///         - amortisation cost is not constant.
-///         - deletion is more expensive than when using a simple array of hazard pointers.
+///         - the list of deleted items grows with the number of hazard pointers,
+///            which may allocate.
 ///         - memory fences used for delete lists on the hazard_pointer_domain, so there
 ///            is a performance hit on deletes performed at the domain level.
 ///
-///
-///  It is possible to combine the deletions across all threads, by specifying the 
-///  delete queue length as 0.
-///  All deletions will be queued on to the hazard pointer domain instance.
-///  The cost is memory required to queue the deletion and fences required for
-///  thread safe queueing.
-///  However this increases the possibility of keeping the delete amortisation cost
-///  constant, actual deletions are only performed when the number of deletions is
-///  > than the total number of hazard pointers.
-///
 ///  Notable features of this scheme and implementation
 ///         - hazard pointer pool creation is linked to creation of hazard pointer 
 ///             contexts.
@@ -108,10 +109,115 @@ namespace benedias {
         /// function call will block until initialisation is complete.
         void hazard_pointer_global_init();
 
-        /// hazard pointer pool, manages reservation and release of a hazard
-        /// pointers in blocks of a size fixed at creation time.
+        /// True if hazard pointers are published using asymmetric fences,
+        /// set by hazard_pointer_global_init if the kernel supports
+        /// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED).
+        /// Define HAZPTR_NO_MEMBARRIER to always use symmetric fences.
+        extern bool hazptr_asymmetric_fences;
+
+        /// Order the store of a hazard pointer before the load validating
+        /// that the object is still reachable.
+        /// With asymmetric fences this is only a compiler barrier, the
+        /// store-load fence is forced on readers by reclaimers, when
+        /// they call hazptr_scan_fence.
+        inline void hazptr_publish_fence()
+        {
+            if (__atomic_load_n(&hazptr_asymmetric_fences, __ATOMIC_RELAXED))
+            {
+                __atomic_signal_fence(__ATOMIC_SEQ_CST);
+            }
+            else
+            {
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            }
+        }
+
+        /// Order the unlinking of retired objects before reading hazard
+        /// pointers. With asymmetric fences every running thread of the
+        /// process executes a full fence, so that hazard pointers published
+        /// before the call are visible.
+        /// Called before taking a snapshot of hazard pointers.
+        void hazptr_scan_fence();
+
+        class hazptr_pool;
+
+        /// Header of a block of hazard pointers, the hazard pointers of the
+        /// block immediately follow the header, so that the header of a
+        /// reserved block is found in constant time on release.
+        struct hazptr_block
+        {
+            /// Link on the free stack of the block size class, only valid
+            /// while the block is on the stack.
+            hazptr_block* next_free = nullptr;
+            hazptr_pool* const pool;
+            const uint32_t index;
+
+            hazptr_block(hazptr_pool* p, uint32_t ix):pool(p),index(ix) {}
+
+            inline generic_hazptr_t* hazard_pointers()
+            {
+                return reinterpret_cast<generic_hazptr_t*>(this + 1);
+            }
+
+            static inline hazptr_block* from_hazard_pointers(generic_hazptr_t* hps)
+            {
+                return reinterpret_cast<hazptr_block*>(hps) - 1;
+            }
+        };
+
+        /// Blocks of hazard pointers are padded and aligned to this size,
+        /// so that threads publishing hazard pointers in different blocks
+        /// do not share cache lines.
+        constexpr std::size_t HAZPTR_CACHE_LINE = 64;
+
+        /// Lock-free stack of free blocks of hazard pointers.
+        /// The head is a tagged pointer, the tag is incremented by every
+        /// update so that a pop racing with a pop and push of the same
+        /// block fails (ABA).
+        struct alignas(HAZPTR_CACHE_LINE) hazptr_free_stack
+        {
+            uint64_t    head = 0;
+
+            /// Pop a free block, lock-free.
+            /// \@return nullptr if the stack is empty.
+            hazptr_block* pop();
+
+            /// Push a chain of free blocks linked through next_free, lock-free.
+            void push(hazptr_block* first, hazptr_block* last);
+        };
+
+        /// Free blocks of hazard pointers of one size.
+        /// On Linux free blocks are kept on per CPU stacks, selected using
+        /// sched_getcpu, blocks released on a CPU are reused by threads
+        /// running on the same CPU, so the cache lines are likely to be warm.
+        /// Define HAZPTR_NO_PERCPU to use a single stack.
+        /// Size classes are never deleted before the domain is destroyed.
+        struct hazptr_size_class
+        {
+            const std::size_t   blk_size;
+            hazptr_size_class*  next = nullptr;
+            const unsigned      nstacks;
+            std::unique_ptr<hazptr_free_stack[]> stacks;
+
+            hazptr_size_class(std::size_t blocksize);
+
+            /// Pop a free block, from the stack of the current CPU if possible,
+            /// lock-free.
+            /// \@return nullptr if there are no free blocks.
+            hazptr_block* pop();
+
+            /// Push a chain of free blocks linked through next_free, onto the
+            /// stack of the current CPU, lock-free.
+            void push(hazptr_block* first, hazptr_block* last);
+        };
+
+        /// hazard pointer pool, the storage for a fixed number of blocks
+        /// of hazard pointers of a size fixed at creation time.
         /// A collection of hazard pointer pools form the set of hazard pointers
         /// for a hazard pointer domain.
+        /// Free blocks are reserved from the free stacks of the size class
+        /// of the pool, the pool bitmap records which blocks are reserved.
+        /// Each block occupies whole cache lines.
         /// The hazard pointer pool class is type agnostic.
 
         // Instances and hazard pointer storage is allocated using std::allocator,
@@ -120,25 +226,32 @@ namespace benedias {
         // TODO: plumbing to use a custom allocator.
         class hazptr_pool {
             private:
-            generic_hazptr_t   *haz_ptrs = nullptr;
-            // bitmap of reserved hazard pointers (1 bit maps to an "array" of length=blk_size)
-            uint32_t    bitmap=0;
+            // Blocks, each a header followed by blk_size hazard pointers,
+            // padded to a multiple of HAZPTR_CACHE_LINE.
+            unsigned char   *storage = nullptr;
+            // bitmap of reserved blocks (1 bit maps to an "array" of length=blk_size)
+            uint64_t    bitmap=0;
 
             protected:
             /// Number of blocks of hazard pointers in a pool.
             static constexpr std::size_t  HAZPTR_POOL_BLOCKS = sizeof(bitmap)*8;
-            static constexpr uint32_t  HAZPTR_POOL_BITMAP_FULL = UINT32_MAX;
+            static constexpr uint64_t  HAZPTR_POOL_BITMAP_FULL = UINT64_MAX;
 
             const std::size_t  blk_size;
             const std::size_t  hp_count;
+            // Distance in bytes between block headers, a multiple of
+            // HAZPTR_CACHE_LINE.
+            const std::size_t  stride;
 
             public:
             // Pools of hazard pointers can be chained.
             hazptr_pool *next = nullptr;
+            hazptr_size_class* const size_class;
 
             /// Constructor
-            /// \@param blocksize the granularity of hazard pointer allocation desried.
-            hazptr_pool(std::size_t blocksize);
+            /// \@param sclass the size class, determines the granularity
+            /// of hazard pointer allocation.
+            hazptr_pool(hazptr_size_class* sclass);
 
             virtual ~hazptr_pool();
 
@@ -147,20 +260,28 @@ namespace benedias {
             /// \@prama count - size of the destination buffer.
             std::size_t copy_hazard_pointers(generic_hazptr_t *dest, std::size_t count) const;
 
-            /// lock-free thread safe reservation of blocks of pointers.
-            /// reservation will only succeed if the requested length is
-            /// matches the block size of the hazard pointer pool, and
-            /// there is at least one free block.
-            /// \@param len - the number of hazard pointers desired.
-            /// \@return pointer to the block of hazard pointers or nullptr.
-            generic_hazptr_t* reserve_impl(std::size_t len);
-
-            /// lock-free thread safe release of blocks of pointers.
-            /// The pointers are only "released" if supplied pointer is to a
-            /// block of hazard pointers contained in this pool.
-            /// \@param pointer to the first hazard pointer in the block.
-            /// \@return true if hazard pointers were released, false otherwise.
-            bool release_impl(generic_hazptr_t* ptr);
+            inline hazptr_block* block(std::size_t ix) const
+            {
+                return reinterpret_cast<hazptr_block*>(storage + ix * stride);
+            }
+
+            /// Reserve the lowest numbered free block, lock-free.
+            /// Used by the creator of a pool, other blocks are reserved
+            /// through the free stack of the size class.
+            /// \@return the block or nullptr if all blocks are reserved.
+            hazptr_block* reserve_impl();
+
+            /// Link the free blocks of the pool into a chain, for pushing
+            /// onto the free stack of the size class.
+            /// \@return the last block in the chain or nullptr.
+            hazptr_block* free_chain(hazptr_block** first) const;
+
+            /// Mark a block popped from the free stack as reserved.
+            void reserved(hazptr_block* blk);
+
+            /// Clear the hazard pointers of a block and mark it as free,
+            /// the caller pushes the block onto the free stack.
+            void release_impl(hazptr_block* blk);
 
             /// Returns simple reservation status for this pool.
             /// This function is a helper function, intended for checking at destruction
@@ -169,7 +290,7 @@ namespace benedias {
             /// \@return true if there are active reservations within the pool.
             inline bool has_reservations()
             {
-                return 0 != bitmap;
+                return 0 != __atomic_load_n(&bitmap, __ATOMIC_ACQUIRE);
             }
 
             inline std::size_t count() const
@@ -180,20 +301,98 @@ namespace benedias {
 
         // constexpr uintptr_t mark_bits_maskoff = ~1;
 
+        /// Contexts scan their deleted items when the number of items reaches
+        /// HAZPTR_SCAN_FACTOR times the number of reserved hazard pointers
+        /// in the domain.
+        constexpr std::size_t HAZPTR_SCAN_FACTOR = 2;
+
+        /// Snapshots with at most this many (non null) hazard pointers are
+        /// searched by linear scan, larger snapshots use a hash set.
+        constexpr std::size_t HAZPTR_SNAPSHOT_LINEAR_MAX = 32;
+
+        /// Batches of items are searched for by comparing every item with every
+        /// value in the snapshot, using vector compares where available,
+        /// if there are at most HAZPTR_SNAPSHOT_BATCH_MAX values and at most
+        /// HAZPTR_SNAPSHOT_BATCH_COMPARES comparisons, otherwise items are
+        /// looked up individually.
+        constexpr std::size_t HAZPTR_SNAPSHOT_BATCH_MAX = 256;
+        constexpr std::size_t HAZPTR_SNAPSHOT_BATCH_COMPARES = 256 * 32;
+
+        /// Test a batch of pointers for membership of a set of values,
+        /// found[i] is set to true if items[i] is one of the values.
+        /// Uses AVX2 or SSE2 compares if the cpu supports them, the
+        /// implementation is selected at run time by hazard_pointer_global_init,
+        /// the scalar implementation is used until then.
+        void hazptr_batch_search(const generic_hazptr_t* values, std::size_t nvalues,
+                const generic_hazptr_t* items, std::size_t nitems, bool* found);
+
+        /// The scalar implementation of hazptr_batch_search.
+        void hazptr_batch_search_scalar(const generic_hazptr_t* values, std::size_t nvalues,
+                const generic_hazptr_t* items, std::size_t nitems, bool* found);
+
+        /// Name of the implementation used by hazptr_batch_search.
+        const char* hazptr_batch_search_isa();
+
         /// Class to snapshot the set of hazard pointers in a domain at a given
         /// point in time.
+        /// Building a snapshot is O(H) and each search is O(1) expected,
+        /// so checking R deleted items is O(R + H).
+        /// Snapshot storage is a buffer per thread, reused across scans,
+        /// and only reallocated when the number of hazard pointers in the domain
+        /// has grown. A heap allocation is only used if the thread's buffer is in
+        /// use by another snapshot.
         class hazptrs_snapshot
         {
             const hazptr_pool* pools;
-            //TODO: try a version with vectors to measure performance.
+            // Heap storage, if the thread's buffer was in use.
             generic_hazptr_t* ptrvalues = nullptr;
             generic_hazptr_t* begin = nullptr;
             generic_hazptr_t* end = nullptr;
+            // Open addressed hash set of the values between begin and end,
+            // linear probing, nullptr marks empty entries.
+            // nullptr if the values are searched linearly.
+            generic_hazptr_t* table = nullptr;
+            std::size_t table_mask = 0;
             std::size_t size = 0;
+            // Cleared to return the thread's buffer, if used.
+            bool* buffer_in_use = nullptr;
 
             // Move helper function.
             void reset();
 
+            static inline std::size_t hash(generic_hazptr_t ptr)
+            {
+                uintptr_t v = reinterpret_cast<uintptr_t>(ptr);
+                v ^= v >> 17;
+                v *= static_cast<uintptr_t>(UINT64_C(0x9e3779b97f4a7c15));
+                v ^= v >> 29;
+                return v;
+            }
+
+            inline bool contains(generic_hazptr_t ptr) const
+            {
+                if (nullptr == table)
+                {
+                    // Branch free, for small snapshots a linear scan
+                    // is cheaper than hashing.
+                    bool found = false;
+                    for(const generic_hazptr_t* p = begin; p < end; ++p)
+                    {
+                        found |= (*p == ptr);
+                    }
+                    return found;
+                }
+                for(std::size_t ix = hash(ptr) & table_mask; nullptr != table[ix];
+                        ix = (ix + 1) & table_mask)
+                {
+                    if (table[ix] == ptr)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
             public:
                 // Partially movable
                 hazptrs_snapshot(hazptrs_snapshot&& other);
@@ -204,7 +403,27 @@ namespace benedias {
 
                 template<class T> inline bool search(T* ptr)
                 {
-                    return std::binary_search(begin, end, reinterpret_cast<generic_hazptr_t>(ptr));
+                    return contains(reinterpret_cast<generic_hazptr_t>(ptr));
+                }
+
+                /// Search for a batch of items.
+                /// \@param found - set to true for items in the snapshot.
+                template<class T> inline void search(T* const* items, std::size_t count, bool* found)
+                {
+                    auto gitems = reinterpret_cast<const generic_hazptr_t*>(items);
+                    std::size_t nvalues = end - begin;
+                    if (nvalues <= HAZPTR_SNAPSHOT_BATCH_MAX
+                            && nvalues * count <= HAZPTR_SNAPSHOT_BATCH_COMPARES)
+                    {
+                        hazptr_batch_search(begin, nvalues, gitems, count, found);
+                    }
+                    else
+                    {
+                        for(std::size_t ix = 0; ix < count; ++ix)
+                        {
+                            found[ix] = contains(gitems[ix]);
+                        }
+                    }
                 }
         };
 
@@ -247,8 +466,25 @@ namespace benedias {
                 }
 
             template <typename U, class Allocator> friend class hazard_pointer_domain;
+            template <typename U, std::size_t S, std::size_t R, class Allocator> friend class hazard_pointer_context;
+
+                // Used by protect, the store is ordered before validation
+                // by hazptr_publish_fence.
+                // Release, because protection is moved between slots by
+                // stores to other slots, for example a traversal holds cur
+                // in HP_CUR then protects the next node in HP_NEXT.
+                // A relaxed store here could become visible before the
+                // store of cur, and a snapshot reading HP_NEXT first would
+                // then see neither copy of cur.
+                // A plain store on x86, stlr on ARM.
+                inline void publish(T* nptr)
+                {
+                    __atomic_store_n(&ptr, nptr, __ATOMIC_RELEASE);
+                }
 
             public:
+                // Release, a pointer moved from another hazard pointer must
+                // not be seen to be overwritten before it is published here.
                 hazard_pointer& operator=(T* nptr)
                 {
                     __atomic_store_n(&ptr, nptr, __ATOMIC_RELEASE);
@@ -284,7 +520,69 @@ namespace benedias {
         /// using the domain memory allocator.
         struct domain_reclaimer
         {
-            virtual void reclaim_object(generic_hazptr_t item_ptr)=0;
+            /// Reclaim a batch of objects which were queued on the delete
+            /// list of a hazptr_domain, at most HAZPTR_RECLAIM_BATCH.
+            virtual void reclaim_batch(generic_hazptr_t* items, std::size_t count)=0;
+            /// Reclaim objects queued for deletion which are no longer
+            /// protected by hazard pointers.
+            virtual void collect()=0;
+        };
+
+        /// Collect cycles reclaim objects in batches of at most this many,
+        /// grouped by domain, see domain_reclaimer::reclaim_batch.
+        constexpr std::size_t HAZPTR_RECLAIM_BATCH = 64;
+
+        /// Allocators which can free many objects at once, for example
+        /// into a node pool, define
+        ///     void deallocate_batch(T** ptrs, std::size_t count);
+        /// which hazard pointer domains use instead of calling
+        /// deallocate for every object.
+        template <class Allocator, typename T, typename = void> struct hazptr_has_deallocate_batch:
+            std::false_type {};
+
+        template <class Allocator, typename T> struct hazptr_has_deallocate_batch<Allocator, T,
+            std::void_t<decltype(std::declval<Allocator&>().deallocate_batch(
+                        std::declval<T**>(), std::size_t()))>>: std::true_type {};
+
+        /// Run class destructors and free memory for a batch of objects,
+        /// with a single call to the allocator if it defines deallocate_batch.
+        template <typename T, class Allocator> void hazptr_destroy_objects(Allocator& allocator,
+                T** items, std::size_t count)
+        {
+            for(std::size_t ix = 0; ix < count; ++ix)
+            {
+                items[ix]->~T();
+            }
+            if constexpr (hazptr_has_deallocate_batch<Allocator, T>::value)
+            {
+                if (0 != count)
+                {
+                    allocator.deallocate_batch(items, count);
+                }
+            }
+            else
+            {
+                for(std::size_t ix = 0; ix < count; ++ix)
+                {
+                    allocator.deallocate(items[ix], 1);
+                }
+            }
+        }
+
+        /// Retire link trait, objects of types with an intrusive retire link
+        /// are queued for deletion on a domain by threading the delete list
+        /// through the objects themselves, so retirement does not allocate.
+        /// The link is only written after the object is retired, readers
+        /// which still hold hazard pointers to it may observe the link.
+        /// Specialisations define
+        ///     static constexpr bool intrusive = true;
+        ///     static T* get(T* obj);
+        ///     static void set(T* obj, T* link);
+        template <typename T> struct hazptr_retire_link
+        {
+            static constexpr bool intrusive = false;
+            static inline T* get(T* obj) { return nullptr; }
+            static inline void set(T* obj, T* link) {}
         };
 
         /// A type agnostic hazard pointer domain defines the set of pointers protected
@@ -312,8 +610,10 @@ namespace benedias {
             /// over the lifetime of the domain.
             hazptr_pool* pools_head = nullptr;
 
-            // domain hazard pointer count
-            int    hp_count=0;
+            // domain hazard pointer count, updated atomically.
+            std::size_t hp_count=0;
+            // reserved hazard pointer count, updated atomically.
+            std::size_t hp_reserved=0;
 
             /// list of delete nodes, overflow from hazard_pointer_context instances,
             /// or no longer in a hazard_pointer_context scope (the
@@ -325,44 +625,19 @@ namespace benedias {
             /// (see collect).
             hazp_delete_node* delete_head = nullptr;
 
-            // domain pending deletes count.
-            // This counter is used trigger collect cycles when the number
-            // of deletes exceeds the number of hazard pointers.
-            // delete_count and the delete list cannot both
-            // be updated  in a single atomic operation,
-            // is in reality delete_count is a close approximation
-            // of the length of the delete list.
-            // For triggering purposes this approximation is considered good enough.
-            // delete_count is zeroed out before the delete list is 
-            // swapped out, so its value may be higher than the number of pending
-            // deletes.
-            int    delete_count=0;
-
-            /// For lock-free operation, we push new hazard pointer pools
-            /// to head of the list (pool) atomically.
-            void pools_new(hazptr_pool** phead, std::size_t blocklen);
-
-            /// Attempt to fulfil a reservation request by requesting
-            /// a block from with the set of hazard pointer pools.
-            /// Reserving hazard pointers is "expensive",
-            /// and occurs at hazard pointer context creation.
-            /// This performance hit can be amortised using a lock free pool
-            /// or cache, of hazard pointer contexts, this will increase memory
-            /// usage.
-            /// \@param head - start of pool of hazard pointer pools.
-            /// \@param blocklen - number of hazard pointers required
-            /// \@return - nullptr or pointer to the block of hazard pointers.
-            generic_hazptr_t* pools_reserve(hazptr_pool* head, std::size_t blocklen);
-
-            /// Release previously reserved hazard pointer reservations.
-            /// Releasing hazard pointers is "expensive",
-            /// and occurs at hazard pointer context creation.
-            /// This performance hit can be amortised using a lock free pool
-            /// or cache, of hazard pointer contexts, this will increase memory
-            /// usage.
-            /// \@param head - pointer to list of hazard pointer blocks.
-            /// \@param ptr - hazard pointer block to be released.
-            bool pools_release(hazptr_pool* head, generic_hazptr_t* ptr);
+            /// list of block size classes, only ever added to over the
+            /// lifetime of the domain, there are typically very few.
+            hazptr_size_class* classes_head = nullptr;
+
+            /// Find or create the size class for a block length, lock-free.
+            hazptr_size_class* size_class(std::size_t blocklen);
+
+            /// Create a new pool for a size class, and push it onto the
+            /// list of pools atomically.
+            /// The pool's free blocks other than the one returned are pushed
+            /// onto the size class free stack.
+            /// \@return a reserved block of the new pool.
+            hazptr_block* pools_new(hazptr_size_class* sclass);
 
             hazptr_domain()
             {
@@ -379,9 +654,12 @@ namespace benedias {
 
             template <typename U, class Allocator> friend class hazard_pointer_domain;
 
+            public:
             /// Create a hazard pointer domain object. 
             /// The return type is std::shared ptr for safe access across
             /// multiple thread scopes.
+            /// The domain may be shared by hazard_pointer_domain instances
+            /// of different types, see hazard_pointer_domain::make.
             /// \return shared pointer to the domain object.
             static std::shared_ptr<hazptr_domain> make()
             {
@@ -393,19 +671,25 @@ namespace benedias {
                 return std::make_shared<makeT>();
             }
 
-            public:
-            /// Fulfill a reservation request using the set of hazard pointer pools
-            /// creating a new instance of hazard pointer pool if required.
+            /// The process wide domain, created on first use.
+            /// Containers using the process wide domain share hazard pointer
+            /// blocks and delete lists, so blocks released by one container
+            /// are reused by the others, and collect cycles and snapshots
+            /// cover a single set of pools.
+            static std::shared_ptr<hazptr_domain> global();
+
+            /// Fulfill a reservation request from the free stack of the
+            /// size class, creating a new instance of hazard pointer pool
+            /// if required.
+            /// Constant time in the number of pools, lock-free unless a pool
+            /// is created.
             /// \@param blocklen - the number of hazard pointers required.
             generic_hazptr_t* reserve(std::size_t blocklen);
 
-            /// Release hazard pointers previously reserved.
+            /// Release hazard pointers previously reserved,
+            /// lock-free and constant time.
             /// \@param ptr - the hazard pointer(s) to be released.
-            inline void release(generic_hazptr_t* hps, std::size_t blocklen)
-            {
-                bool released = pools_release(pools_head, hps);
-                assert(released);
-            }
+            void release(generic_hazptr_t* hps, std::size_t blocklen);
 
             /// Add a pointer to the delete list.
             /// Creates and pushes a delete node onto the delete list,
@@ -424,7 +708,25 @@ namespace benedias {
             /// atomically to thread running the collect function.
             void collect();
 
-            void collect_if_required();
+            /// Number of hazard pointers in the domain.
+            inline std::size_t hazard_pointer_count() const
+            {
+                return __atomic_load_n(&hp_count, __ATOMIC_RELAXED);
+            }
+
+            /// Number of hazard pointers reserved by contexts, H.
+            /// Released hazard pointers are cleared, so at most H objects
+            /// are protected.
+            inline std::size_t reserved_hazard_pointer_count() const
+            {
+                return __atomic_load_n(&hp_reserved, __ATOMIC_RELAXED);
+            }
+
+            /// True if there are objects on the delete list.
+            inline bool has_pending_deletes() const
+            {
+                return nullptr != __atomic_load_n(&delete_head, __ATOMIC_ACQUIRE);
+            }
 
             inline hazptrs_snapshot snapshot()
             {
@@ -435,21 +737,142 @@ namespace benedias {
         };
 
 
+        /// Background reclamation of deleted objects, for one or more
+        /// hazard pointer domains.
+        /// Contexts of domains attached to a reclaimer neither scan nor
+        /// reclaim, deleted objects are queued on the domain delete list.
+        /// The reclaimer thread collects the delete lists of all attached
+        /// domains when woken by a context which has queued enough deletions,
+        /// and periodically.
+        class hazptr_reclaimer
+        {
+            std::mutex  mutex;
+            std::condition_variable cv;
+            // Attached domains, guarded by mutex, which is held
+            // for the duration of collect cycles.
+            std::vector<domain_reclaimer*> domains;
+            bool        requested = false;
+            bool        stop = false;
+            const std::chrono::milliseconds period;
+            std::thread worker;
+
+            explicit hazptr_reclaimer(std::chrono::milliseconds period);
+            void run();
+
+            public:
+            // Non copyable
+            hazptr_reclaimer& operator=(const hazptr_reclaimer&) = delete;
+            hazptr_reclaimer(hazptr_reclaimer const&) = delete;
+
+            // Non movable
+            hazptr_reclaimer& operator=(hazptr_reclaimer&&) = delete;
+            hazptr_reclaimer(hazptr_reclaimer&&) = delete;
+
+            ~hazptr_reclaimer();
+
+            /// Create a reclaimer and start its thread.
+            /// \@param period - interval between collect cycles when not woken.
+            static std::shared_ptr<hazptr_reclaimer> make(
+                    std::chrono::milliseconds period=std::chrono::milliseconds(10));
+
+            void attach(domain_reclaimer* domain);
+
+            /// Blocks until a collect cycle in progress has completed.
+            void detach(domain_reclaimer* domain);
+
+            /// Wake the reclaimer thread, lock free, a lost wake up is
+            /// covered by the periodic collect.
+            void request();
+        };
+
         /// A hazard pointer domain defines the set of pointers protected
         /// and checked against for safe memory reclamation.
         /// Typically a hazard pointer domain instance will be associated with
         /// a single instance of a container class, but sharing across multiple
         /// containers of the same type is supported.
+        /// The underlying type agnostic hazptr_domain may be shared with
+        /// hazard pointer domains of other types.
         template <typename T, class Allocator=std::allocator<T>> class hazard_pointer_domain: public domain_reclaimer
         {
             std::shared_ptr<hazptr_domain> hp_dom;
+            // Objects of this domain on delete lists, the hazptr_domain
+            // delete list and the intrusive delete list.
+            std::size_t queued = 0;
+            // Budget for queued objects, 0 is unlimited.
+            std::size_t budget_objects = 0;
+            std::size_t budget_bytes = 0;
+            std::size_t object_size = sizeof(T);
             //Allocator used for objects created in this domain.
             Allocator allocatorT;
+            // Background reclaimer, if any.
+            std::shared_ptr<hazptr_reclaimer> background;
+            // Delete list threaded through objects with intrusive retire links.
+            T* retired_head = nullptr;
+            using retire_link = hazptr_retire_link<T>;
+
+            /// Push a chain of retired objects, linked through retire links,
+            /// lock free.
+            void push_retired(T* first, T* last)
+            {
+                T* head = __atomic_load_n(&retired_head, __ATOMIC_RELAXED);
+                do
+                {
+                    retire_link::set(last, head);
+                }while(!__atomic_compare_exchange_n(&retired_head, &head, first,
+                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+            }
+
+            /// Reclaim objects on the intrusive delete list which are not
+            /// protected, the list is taken atomically, as for hazptr_domain::collect.
+            void collect_retired()
+            {
+                T* list = __atomic_exchange_n(&retired_head, nullptr, __ATOMIC_ACQ_REL);
+                if (nullptr == list)
+                {
+                    return;
+                }
+                T* first = nullptr;
+                T* last = nullptr;
+                T* batch[HAZPTR_RECLAIM_BATCH];
+                std::size_t count = 0;
+                std::size_t reclaimed = 0;
+                hazptrs_snapshot  hps = hp_dom->snapshot();
+                while(nullptr != list)
+                {
+                    T* next = retire_link::get(list);
+                    if (hps.search(list))
+                    {
+                        retire_link::set(list, first);
+                        first = list;
+                        if (nullptr == last)
+                        {
+                            last = list;
+                        }
+                    }
+                    else
+                    {
+                        batch[count++] = list;
+                        ++reclaimed;
+                        if (HAZPTR_RECLAIM_BATCH == count)
+                        {
+                            reclaim_objects(batch, count);
+                            count = 0;
+                        }
+                    }
+                    list = next;
+                }
+                reclaim_objects(batch, count);
+                __atomic_sub_fetch(&queued, reclaimed, __ATOMIC_RELEASE);
+                if (nullptr != first)
+                {
+                    push_retired(first, last);
+                }
+            }
 
             private:
-            hazard_pointer_domain()
+            explicit hazard_pointer_domain(std::shared_ptr<hazptr_domain> dom):
+                hp_dom(dom ? dom : hazptr_domain::make())
             {
-                hp_dom = hazptr_domain::make();
             }
 
             /// Since the instances of domain pointers are only accessible, 
@@ -457,14 +880,24 @@ namespace benedias {
             /// reference (shared pointer) to this domain is destroyed.
             ~hazard_pointer_domain()
             {
+                if (background)
+                {
+                    background->detach(this);
+                }
                 // The domain is being destroyed, so all items scheduled for delete
                 // should be deleted first.
-                hp_dom->collect();
-                // FIXME: add a check that there are no items associated with this
-                // domain still queued for delete, that would be a bug and 
-                // this instance being invoked after destruction,
-                // because  delete nodes have reference to this object for
-                // memory reclamation.
+                collect();
+                // Delete nodes have a reference to this object for memory
+                // reclamation. If the hazptr_domain is shared, a collect
+                // cycle on another thread may hold some of them, the contexts
+                // of this domain are gone so they are not protected,
+                // wait until they have been reclaimed.
+                while(0 != __atomic_load_n(&queued, __ATOMIC_ACQUIRE))
+                {
+                    std::this_thread::yield();
+                    collect();
+                }
+                assert(nullptr == retired_head);
             }
 
             public:
@@ -472,14 +905,50 @@ namespace benedias {
             /// The return type is std::shared ptr for safe access across
             /// multiple thread scopes.
             /// \return shared pointer to the domain object.
-            static std::shared_ptr<hazard_pointer_domain<T>> make()
+            static std::shared_ptr<hazard_pointer_domain<T, Allocator>> make()
+            {
+                return make(std::shared_ptr<hazptr_domain>(nullptr));
+            }
+
+            /// Create a hazard pointer domain object using a shared type
+            /// agnostic domain, for example hazptr_domain::global().
+            /// \@param dom - the shared domain, nullptr for a private domain.
+            static std::shared_ptr<hazard_pointer_domain<T, Allocator>> make(
+                    std::shared_ptr<hazptr_domain> dom)
             {
                 // This round about way, to ensure that the lifetime of
                 // hazard pointer domain objects exceeds the lifetime of
                 // all associated hazard_pointer_context objects, so
                 // prevent access to the constructors and destructors.
-                struct makeT:public hazard_pointer_domain<T> {};
-                return std::make_shared<makeT>();
+                struct makeT:public hazard_pointer_domain<T, Allocator>
+                {
+                    makeT(std::shared_ptr<hazptr_domain> d):hazard_pointer_domain<T, Allocator>(d) {}
+                };
+                return std::make_shared<makeT>(dom);
+            }
+
+            /// Create a hazard pointer domain object, with reclamation
+            /// performed by a background reclaimer.
+            /// \@param reclaimer - may be shared with other domains,
+            /// nullptr for inline reclamation.
+            /// \@param dom - shared type agnostic domain, nullptr for a
+            /// private domain.
+            static std::shared_ptr<hazard_pointer_domain<T, Allocator>> make(
+                    std::shared_ptr<hazptr_reclaimer> reclaimer,
+                    std::shared_ptr<hazptr_domain> dom=nullptr)
+            {
+                auto domain = make(dom);
+                if (reclaimer)
+                {
+                    domain->background = reclaimer;
+                    reclaimer->attach(domain.get());
+                }
+                return domain;
+            }
+
+            inline hazptr_reclaimer* background_reclaimer() const
+            {
+                return background.get();
             }
 
             /// Fulfill a reservation request using the set of hazard pointer pools
@@ -504,22 +973,110 @@ namespace benedias {
 
             /// Add a pointer to the delete list.
             /// Creates and pushes a delete node onto the delete list,
-            /// lock free and wait free.
-            inline void enqueue_for_delete(T* item_ptr, bool can_collect=true)
+            /// or if T has an intrusive retire link, pushes the object
+            /// without allocating, lock free.
+            /// If the retired budget is exceeded, the delete lists are
+            /// collected synchronously.
+            inline void enqueue_for_delete(T* item_ptr)
             {
-                hp_dom->enqueue_for_delete(reinterpret_cast<generic_hazptr_t>(item_ptr), *this);
-                if (can_collect)
-                    hp_dom->collect_if_required();
+                __atomic_add_fetch(&queued, 1, __ATOMIC_RELAXED);
+                if (retire_link::intrusive)
+                {
+                    push_retired(item_ptr, item_ptr);
+                }
+                else
+                {
+                    hp_dom->enqueue_for_delete(reinterpret_cast<generic_hazptr_t>(item_ptr), *this);
+                }
+                if (over_retired_budget())
+                {
+                    collect();
+                }
             }
 
             /// Add a set of pointers to the delete list.
             /// Creates and pushes a delete nodes onto the delete list,
-            /// lock free and wait free.
-            inline void enqueue_for_delete(T** items_ptr, std::size_t count, bool can_collect=true)
+            /// or if T has an intrusive retire link, pushes the objects
+            /// as a single chain without allocating, lock free.
+            inline void enqueue_for_delete(T** items_ptr, std::size_t count)
+            {
+                __atomic_add_fetch(&queued, std::count_if(items_ptr, items_ptr + count,
+                            [](T* item){return nullptr != item;}), __ATOMIC_RELAXED);
+                if (retire_link::intrusive)
+                {
+                    if (count > 0)
+                    {
+                        for(std::size_t x = 0; x + 1 < count; ++x)
+                        {
+                            retire_link::set(items_ptr[x], items_ptr[x + 1]);
+                        }
+                        push_retired(items_ptr[0], items_ptr[count - 1]);
+                    }
+                }
+                else
+                {
+                    hp_dom->enqueue_for_delete(reinterpret_cast<generic_hazptr_t*>(items_ptr), *this, count);
+                }
+                if (over_retired_budget())
+                {
+                    collect();
+                }
+            }
+
+            /// Limit the memory held by retired objects on the delete lists
+            /// of this domain, objects held by contexts are not counted,
+            /// there are at most max(R, HAZPTR_SCAN_FACTOR * H) per context.
+            /// Past the budget enqueue_for_delete collects synchronously,
+            /// producers may throttle using over_retired_budget.
+            /// Not thread safe, set before the domain is in use.
+            /// \@param max_objects - object count budget, 0 is unlimited.
+            /// \@param max_bytes - memory budget, 0 is unlimited.
+            /// \@param size - bytes per object, for types with derived
+            /// classes, the size of the largest.
+            void set_retired_budget(std::size_t max_objects, std::size_t max_bytes,
+                    std::size_t size=sizeof(T))
+            {
+                budget_objects = max_objects;
+                budget_bytes = max_bytes;
+                object_size = size;
+            }
+
+            /// Number of objects on the delete lists of this domain.
+            inline std::size_t retired_count() const
+            {
+                return __atomic_load_n(&queued, __ATOMIC_RELAXED);
+            }
+
+            /// Estimated memory held by objects on the delete lists.
+            inline std::size_t retired_bytes() const
             {
-                hp_dom->enqueue_for_delete(reinterpret_cast<generic_hazptr_t*>(items_ptr), *this, count);
-                if (can_collect)
-                    hp_dom->collect_if_required();
+                return retired_count() * object_size;
+            }
+
+            /// True if the retired objects exceed the budget, typically
+            /// because a reader holding hazard pointers has stalled or
+            /// reclamation is not keeping up.
+            inline bool over_retired_budget() const
+            {
+                std::size_t count = retired_count();
+                return (0 != budget_objects && count > budget_objects)
+                    || (0 != budget_bytes && count * object_size > budget_bytes);
+            }
+
+            inline std::size_t hazard_pointer_count() const
+            {
+                return hp_dom->hazard_pointer_count();
+            }
+
+            inline std::size_t reserved_hazard_pointer_count() const
+            {
+                return hp_dom->reserved_hazard_pointer_count();
+            }
+
+            inline bool has_pending_deletes() const
+            {
+                return hp_dom->has_pending_deletes()
+                    || nullptr != __atomic_load_n(&retired_head, __ATOMIC_ACQUIRE);
             }
 
             /// Delete objects on the delete list if no live pointers to
@@ -530,16 +1087,30 @@ namespace benedias {
             void collect()
             {
                 hp_dom->collect();
+                collect_retired();
             }
 
             /// Run class destructor and free memory allocated for this domain.
             /// this will only be lock-free if the destructor is lock-free and
             /// the allocator is lock-free.
-            void reclaim_object(generic_hazptr_t item_ptr)
+            void reclaim_object(T* ptr)
+            {
+                reclaim_objects(&ptr, 1);
+            }
+
+            /// Run class destructors and free memory for a batch of objects,
+            /// with a single call to the allocator if it defines
+            /// deallocate_batch.
+            inline void reclaim_objects(T** items, std::size_t count)
             {
-                T* ptr = reinterpret_cast<T*>(item_ptr);
-                ptr->~T();
-                allocatorT.deallocate(ptr, 1);
+                hazptr_destroy_objects(allocatorT, items, count);
+            }
+
+            void reclaim_batch(generic_hazptr_t* items, std::size_t count)
+            {
+                reclaim_objects(reinterpret_cast<T**>(items), count);
+                // Last access to this instance, see the destructor.
+                __atomic_sub_fetch(&queued, count, __ATOMIC_RELEASE);
             }
 
             inline hazptrs_snapshot snapshot()
@@ -552,18 +1123,63 @@ namespace benedias {
                "sizeof hazard_pointer class does not match preallocated storage.");
 
 
+        /// Traits of the sources of pointers protected by
+        /// hazard_pointer_context::protect.
+        /// load returns the pointer with any mark bits stripped, so that the
+        /// published hazard pointer compares equal to the retired pointer,
+        /// and stores the mark in *mark, order is __ATOMIC_RELAXED or
+        /// __ATOMIC_ACQUIRE.
+        template <typename P> struct hazptr_protect_traits;
+
+        template <typename U> struct hazptr_protect_traits<mark_ptr_type<U>>
+        {
+            static constexpr bool marked = true;
+            static inline U* load(const mark_ptr_type<U>& src, bool* mark, int order)
+            {
+                return src.load(mark, order);
+            }
+        };
+
+        template <typename U> struct hazptr_protect_traits<tagged_mark_ptr<U>>
+        {
+            static constexpr bool marked = true;
+            static inline U* load(const tagged_mark_ptr<U>& src, bool* mark, int order)
+            {
+                return src.load(order).ptr(mark);
+            }
+        };
+
+        template <typename U> struct hazptr_protect_traits<std::atomic<U*>>
+        {
+            static constexpr bool marked = false;
+            static inline U* load(const std::atomic<U*>& src, bool* mark, int order)
+            {
+                *mark = false;
+                return src.load(__ATOMIC_RELAXED == order ?
+                        std::memory_order_relaxed : std::memory_order_acquire);
+            }
+        };
+
         /// This class encapsulates the execution context required for 
         /// use of hazard_pointers by a single thread.
         /// It implements the SMR algorithm described by Maged Micheal,
         /// in "Safe Memory Reclamation for Dynamic Lock-Free Objects
         /// Using Atomic Reads and Write".
         /// The implementation is not verbatim.
-        template <typename T, std::size_t S, std::size_t R> class hazard_pointer_context
+        /// S - the number of hazard pointers.
+        /// R - the minimum number of deleted objects held before a scan.
+        template <typename T, std::size_t S, std::size_t R, class Allocator=std::allocator<T>> class hazard_pointer_context
         {
             private:
-            std::shared_ptr<hazard_pointer_domain<T>> domain;
-            T* deleted[R]={};
-            std::size_t del_index=0;
+            std::shared_ptr<hazard_pointer_domain<T, Allocator>> domain;
+            // Objects retired by this context, pending reclamation.
+            std::vector<T*> deleted;
+            // Results of searching the snapshot for deleted objects.
+            std::unique_ptr<bool[]> hazardous;
+            std::size_t hazardous_size = 0;
+            // Deletions queued on the domain since the background reclaimer
+            // was last woken.
+            std::size_t queued = 0;
             hazard_pointer<T>*const hazard_ptrs;
 
             public:
@@ -576,19 +1192,20 @@ namespace benedias {
 
             hazard_pointer_context& operator=(const hazard_pointer_context&& other)=delete;
             // Partially movable, to allow returning of hazard_pointer_context objects.
-            hazard_pointer_context(hazard_pointer_context<T,S,R>&& other):
-                domain(std::move(other.domain)), hazard_ptrs(std::move(other.hazard_ptrs)),size(std::move(other.size))
+            hazard_pointer_context(hazard_pointer_context<T,S,R,Allocator>&& other):
+                domain(std::move(other.domain)), deleted(std::move(other.deleted)),
+                hazardous(std::move(other.hazardous)), hazardous_size(other.hazardous_size),
+                queued(other.queued),
+                hazard_ptrs(std::move(other.hazard_ptrs)),size(std::move(other.size))
             {
-                for(unsigned i=0; i < R; ++i)
-                    deleted[i] = std::move(other.deleted[i]);
-                del_index = std::move(other.del_index);
             }
 
-            hazard_pointer_context(std::shared_ptr<hazard_pointer_domain<T>> dom):
+            hazard_pointer_context(std::shared_ptr<hazard_pointer_domain<T, Allocator>> dom):
                 domain(dom), hazard_ptrs(domain->reserve(S)), size(S)
             {
                 //FIXME: throw exception.
                 assert(hazard_ptrs != nullptr);
+                deleted.reserve(scan_threshold());
             }
 
             ~hazard_pointer_context()
@@ -600,8 +1217,15 @@ namespace benedias {
                     domain->release(hazard_ptrs, S);
                     // Delegate deletion of nodes to be deleted
                     // to the domain.
-                    domain->enqueue_for_delete(deleted, R);
-                    domain->collect();
+                    domain->enqueue_for_delete(deleted.data(), deleted.size());
+                    if (auto reclaimer = domain->background_reclaimer())
+                    {
+                        reclaimer->request();
+                    }
+                    else
+                    {
+                        domain->collect();
+                    }
                 }
             }
 
@@ -610,76 +1234,118 @@ namespace benedias {
                 return hazard_ptrs;
             }
 
+            /// Number of retired objects at which a scan is performed,
+            /// max(R, HAZPTR_SCAN_FACTOR * H), where H is the current number
+            /// of reserved hazard pointers in the domain, so the threshold
+            /// falls again when contexts are destroyed.
+            /// At most H objects can survive a scan, so at least half of the
+            /// objects scanned are reclaimed.
+            inline std::size_t scan_threshold() const
+            {
+                return std::max(R, HAZPTR_SCAN_FACTOR * domain->reserved_hazard_pointer_count());
+            }
+
             /// Safely delete an object or schedule the object deletion.
             void delete_item(T* item_ptr)
             {
-                if (R > 0)
+                if (auto reclaimer = domain->background_reclaimer())
                 {
-                    assert(del_index <= R);
-                    deleted[del_index] = item_ptr;
-                    ++del_index;
-
-                    // Number of deleted objects has reached the limit
-                    // of local storage, attempt to delete.
-                    if (del_index == R)
+                    // Reclamation is off the caller's path.
+                    domain->enqueue_for_delete(item_ptr);
+                    if (++queued >= scan_threshold())
                     {
-                        // overflow
-                        reclaim();
+                        queued = 0;
+                        reclaimer->request();
                     }
+                    return;
                 }
-                else
+                deleted.push_back(item_ptr);
+                if (deleted.size() >= scan_threshold())
                 {
-                    domain->enqueue_for_delete(item_ptr);
+                    reclaim();
                 }
             }
 
-            /// Safely reclaim storage for deleted objects
-            /// or schedule reclamation for deleted object.
+            /// Safely reclaim storage for deleted objects which are not
+            /// protected by hazard pointers, protected objects are retained
+            /// for the next scan.
+            /// Objects left on the domain by contexts which have been
+            /// destroyed are also collected.
             void reclaim()
             {
-                hazptrs_snapshot  hps = domain->snapshot();
-                for(std::size_t ix=0; ix < R; ++ix)
+                std::size_t count = deleted.size();
+                if (count > 0)
                 {
-                    if (!hps.search(deleted[ix]))
+                    if (hazardous_size < count)
                     {
-                        // on delete zero out the array field,
-                        // and reduce the delete index var.
-                        --del_index;
-                        domain->reclaim_object(deleted[ix]);
-                        deleted[ix] = nullptr;
+                        hazardous_size = deleted.capacity();
+                        hazardous.reset(new bool[hazardous_size]);
                     }
+                    hazptrs_snapshot  hps = domain->snapshot();
+                    hps.search(deleted.data(), count, hazardous.get());
+                    // Move the protected objects to the front, and reclaim
+                    // the rest as a batch.
+                    std::size_t kept = 0;
+                    for(std::size_t ix=0; ix < count; ++ix)
+                    {
+                        if (hazardous[ix])
+                        {
+                            std::swap(deleted[kept++], deleted[ix]);
+                        }
+                    }
+                    domain->reclaim_objects(deleted.data() + kept, count - kept);
+                    deleted.resize(kept);
                 }
 
-                // del_index is not guaranteed to be valid here
-                if (del_index == R)
+                if (domain->has_pending_deletes())
                 {
-                    // Could not delete anything, so enqueue for delete
-                    // on the domain.
-                    domain->enqueue_for_delete(deleted, R);
-                    del_index = 0;
+                    domain->collect();
                 }
-                else
+            }
+
+            /// Load a pointer from src, and publish it in a hazard pointer.
+            /// Loops until the value of src is seen unchanged after
+            /// publishing, the object pointed to is then protected for as
+            /// long as the hazard pointer holds the value.
+            /// \@param index - the hazard pointer to use.
+            /// \@param src - the location to load from.
+            /// \@param mark - set to the mark of the loaded value,
+            /// the returned and published pointer is unmarked.
+            /// \@return the protected pointer.
+            template <typename P> T* protect(std::size_t index, const P& src, bool* mark)
+            {
+                typedef hazptr_protect_traits<P> traits;
+                assert(index < size);
+                // Relaxed, the pointer is only used once validated.
+                T* ptr = traits::load(src, mark, __ATOMIC_RELAXED);
+                while(true)
                 {
-                    // deleted at least one, move undeleted items up,
-                    // so that ix_delete is valid once again.
-                    std::size_t ixd=0, ixs=R-1;
-                    while(ixd < ixs)
+                    hazard_ptrs[index].publish(ptr);
+                    // The hazard pointer must be visible to reclaimers
+                    // before the validating load.
+                    hazptr_publish_fence();
+                    T* validate = traits::load(src, mark, __ATOMIC_ACQUIRE);
+                    if (validate == ptr)
                     {
-                        while(nullptr != deleted[ixd] && ixd < ixs)
-                            ++ixd;
-                        while(nullptr == deleted[ixs] && ixd < ixs)
-                            --ixs;
-                        if (nullptr != deleted[ixs]
-                                && nullptr == deleted[ixd])
-                        {
-                            std::swap(deleted[ixs], deleted[ixd]);
-                            ++ixd;
-                            --ixs;
-                        }
+                        return ptr;
                     }
+                    ptr = validate;
                 }
             }
 
+            inline T* protect(std::size_t index, const mark_ptr_type<T>& src, bool* mark)
+            {
+                return protect<mark_ptr_type<T>>(index, src, mark);
+            }
+
+            inline T* protect(std::size_t index, const std::atomic<T*>& src)
+            {
+                bool mark;
+                return protect<std::atomic<T*>>(index, src, &mark);
+            }
+
+            /// Publish the value at pptr as is, the value is not validated,
+            /// and must not be marked, see protect.
             T* store(std::size_t index, T** pptr)
             {
                 assert(index < size);
@@ -704,8 +1370,15 @@ namespace benedias {
         // creation of associated hazard_pointer_context objects.
         template <typename T, std::size_t S, std::size_t R> class hazard_pointer_assoc
         {
-            std::shared_ptr<hazard_pointer_domain<T>> dom = hazard_pointer_domain<T>::make();
+            std::shared_ptr<hazard_pointer_domain<T>> dom;
             public:
+            /// \@param shared - type agnostic domain shared with other
+            /// containers, nullptr for a private domain.
+            explicit hazard_pointer_assoc(std::shared_ptr<hazptr_domain> shared=nullptr):
+                dom(hazard_pointer_domain<T>::make(shared))
+            {
+            }
+
             hazard_pointer_context<T, S, R> context()
             {
                 return std::move(hazard_pointer_context<T, S, R>(dom));
@@ -16,6 +16,8 @@ You should have received a copy of the GNU General Public License
 along with this file.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "hazard_pointer.hpp"
+#include <array>
+#include <atomic>
 #include <clocale>
 #include <cstdio>
 #include <cstdlib>
@@ -23,13 +25,18 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 #include <ctime>
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
 
 using   benedias::concurrent::hazard_pointer_assoc;
 using   benedias::concurrent::hazard_pointer_domain;
 using   benedias::concurrent::hazard_pointer_context;
 using   benedias::concurrent::hazard_pointer;
+using   benedias::concurrent::mark_ptr_type;
 
 unsigned scope = 0;
+std::atomic<unsigned> b_dtor_count{0};
 void indent()
 {
     unsigned v = scope;
@@ -47,6 +54,7 @@ struct  B
     }
     ~B()
     {
+        ++b_dtor_count;
 #if 0
         // :-( MSAN generates a fault for this, but not the equivalent 
         // sequence of statements below.
@@ -254,11 +262,447 @@ indent();std::cout << "hp1 scope end" << std::endl;
 indent();std::cout << "hpdom scope end" << std::endl;
 }
 
+// Snapshot searches, small snapshots are scanned linearly,
+// large snapshots are hashed.
+// Nested snapshots do not share storage.
+void test4()
+{
+indent();std::cout << "test4 snapshot search, linear scan, hash set, batch and nested snapshots." << std::endl;
+    std::array<B*, 200> tcs;
+    for(unsigned i=0; i < tcs.size(); ++i)
+    {
+        tcs[i] = new B(i);
+    }
+    {
+        auto hpdom = hazard_pointer_domain<B>::make();
+indent();std::cout << "batch search using " << benedias::concurrent::hazptr_batch_search_isa() << std::endl;
+        std::vector<std::unique_ptr<hazard_pointer_context<B, 3, 0>>> hpcs;
+        for (std::size_t nprotected : {4, 60})
+        {
+            while (hpcs.size() * 3 < nprotected)
+            {
+                hpcs.emplace_back(new hazard_pointer_context<B, 3, 0>(hpdom));
+            }
+            for (std::size_t i = 0; i < nprotected; ++i)
+            {
+                hpcs[i/3]->store(i%3, tcs[i]);
+            }
+            auto hps = hpdom->snapshot();
+            auto nested = hpdom->snapshot();
+            std::array<bool, tcs.size()> found;
+            hps.search(tcs.data(), tcs.size(), found.data());
+            unsigned errors = 0;
+            for (std::size_t i = 0; i < tcs.size(); ++i)
+            {
+                bool expect = i < nprotected;
+                if (hps.search(tcs[i]) != expect || nested.search(tcs[i]) != expect
+                        || found[i] != expect)
+                {
+                    ++errors;
+                }
+            }
+indent();std::cout << nprotected << " protected, " << (errors ? "Failed! " : "") << errors << " search errors" << std::endl;
+        }
+        hpcs.clear();
+    }
+    for(auto b: tcs)
+    {
+        delete b;
+    }
+}
+
+// Contexts scan when the number of deleted items reaches max(R, k.H),
+// protected items survive scans and remain with the context.
+void test5()
+{
+indent();std::cout << "test5 adaptive scan threshold, protected items survive scans." << std::endl;
+    std::array<B*, 600> tcs;
+    for(unsigned i=0; i < tcs.size(); ++i)
+    {
+        tcs[i] = new B(i);
+    }
+    unsigned dtor_base = b_dtor_count;
+    {
+        auto hpdom = hazard_pointer_domain<B>::make();
+        {
+            auto hpc = hazard_pointer_context<B, 3, 4>(hpdom);
+            std::size_t threshold = hpc.scan_threshold();
+            hpc.store(0, tcs[0]);
+            for(auto b: tcs)
+            {
+                hpc.delete_item(b);
+            }
+            unsigned reclaimed = b_dtor_count - dtor_base;
+indent();std::cout << "threshold " << threshold << " for " << hpdom->reserved_hazard_pointer_count()
+                << " reserved hazard pointers, reclaimed " << reclaimed << " of " << tcs.size() << std::endl;
+            if (reclaimed + threshold < tcs.size() || reclaimed == tcs.size())
+            {
+indent();std::cout << "Failed! unexpected number of reclaimed items" << std::endl;
+            }
+            hpc.store(0, static_cast<B*>(nullptr));
+        }
+        if (b_dtor_count - dtor_base != tcs.size())
+        {
+indent();std::cout << "Failed! items not reclaimed on context destruction" << std::endl;
+        }
+    }
+}
+
+// Deleted items are reclaimed by a background reclaimer, shared by two
+// domains, while the contexts are live.
+void test6()
+{
+indent();std::cout << "test6 background reclaimer shared by two domains." << std::endl;
+    std::array<B*, 20> tcs;
+    for(unsigned i=0; i < tcs.size(); ++i)
+    {
+        tcs[i] = new B(i);
+    }
+    unsigned dtor_base = b_dtor_count;
+    auto reclaimer = benedias::concurrent::hazptr_reclaimer::make(std::chrono::milliseconds(1));
+    {
+        auto hpdom1 = hazard_pointer_domain<B>::make(reclaimer);
+        auto hpdom2 = hazard_pointer_domain<B>::make(reclaimer);
+        auto hpc1 = hazard_pointer_context<B, 3, 4>(hpdom1);
+        auto hpc2 = hazard_pointer_context<B, 3, 4>(hpdom2);
+        hpc1.store(0, tcs[0]);
+        for(unsigned i=0; i < tcs.size(); ++i)
+        {
+            (i & 1 ? hpc2 : hpc1).delete_item(tcs[i]);
+        }
+        for(unsigned wait = 0; wait < 1000 && b_dtor_count - dtor_base < tcs.size() - 1; ++wait)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+indent();std::cout << "reclaimed " << b_dtor_count - dtor_base << " of " << tcs.size() << std::endl;
+        if (b_dtor_count - dtor_base != tcs.size() - 1)
+        {
+indent();std::cout << "Failed! the unprotected items were not reclaimed" << std::endl;
+        }
+        hpc1.store(0, static_cast<B*>(nullptr));
+    }
+    if (b_dtor_count - dtor_base != tcs.size())
+    {
+indent();std::cout << "Failed! items not reclaimed on domain destruction" << std::endl;
+    }
+}
+
+// Blocks of hazard pointers released by contexts are reused, whatever
+// the number of pools, and concurrent reservation and release is safe.
+void test7()
+{
+indent();std::cout << "test7 hazard pointer block reservation and release." << std::endl;
+    auto hpdom = hazard_pointer_domain<B>::make();
+    typedef hazard_pointer_context<B, 3, 4> context3;
+    typedef hazard_pointer_context<B, 5, 4> context5;
+    {
+        // More than one pool per block size.
+        std::vector<std::unique_ptr<context3>> c3;
+        std::vector<std::unique_ptr<context5>> c5;
+        for(unsigned i=0; i < 150; ++i)
+        {
+            c3.emplace_back(new context3(hpdom));
+            c5.emplace_back(new context5(hpdom));
+        }
+    }
+    std::size_t hazard_count = hpdom->hazard_pointer_count();
+indent();std::cout << hazard_count << " hazard pointers" << std::endl;
+
+    std::vector<std::thread> threads;
+    for(unsigned t=0; t < 4; ++t)
+    {
+        threads.emplace_back([hpdom, t]()
+            {
+                for(unsigned i=0; i < 1000; ++i)
+                {
+                    context3 hpc3(hpdom);
+                    context5 hpc5(hpdom);
+                    hpc3.store(2, reinterpret_cast<B*>(0x1000 + t));
+                    hpc5.store(4, reinterpret_cast<B*>(0x2000 + t));
+                }
+            });
+    }
+    for(auto& th: threads)
+    {
+        th.join();
+    }
+    if (hazard_count != hpdom->hazard_pointer_count())
+    {
+indent();std::cout << "Failed! released blocks were not reused, "
+                << hpdom->hazard_pointer_count() << " hazard pointers" << std::endl;
+    }
+    // Only reserved hazard pointers count towards the scan threshold,
+    // so it falls again after the burst of contexts.
+    if (0 != hpdom->reserved_hazard_pointer_count())
+    {
+indent();std::cout << "Failed! " << hpdom->reserved_hazard_pointer_count()
+                << " hazard pointers reserved after release" << std::endl;
+    }
+    {
+        context3 hpc3(hpdom);
+        if (hpc3.scan_threshold() >= hazard_count)
+        {
+indent();std::cout << "Failed! scan threshold " << hpc3.scan_threshold()
+                << " includes unreserved hazard pointers" << std::endl;
+        }
+    }
+    // Released blocks are cleared.
+    auto snapshot = hpdom->snapshot();
+    for(unsigned t=0; t < 4; ++t)
+    {
+        if (snapshot.search(reinterpret_cast<B*>(0x1000 + t))
+                || snapshot.search(reinterpret_cast<B*>(0x2000 + t)))
+        {
+indent();std::cout << "Failed! released hazard pointers were not cleared" << std::endl;
+        }
+    }
+}
+
+// protect publishes the unmarked pointer, so marked sources are protected.
+void test8()
+{
+indent();std::cout << "test8 protect marked and atomic sources." << std::endl;
+    auto hpdom = hazard_pointer_domain<B>::make();
+    auto hpc = hazard_pointer_context<B, 2, 4>(hpdom);
+    B* b1 = new B(1);
+    B* b2 = new B(2);
+    mark_ptr_type<B> mp(b1);
+    mp.mark();
+    std::atomic<B*> ap(b2);
+    bool mark = false;
+    B* p1 = hpc.protect(0, mp, &mark);
+    B* p2 = hpc.protect(1, ap);
+    if (p1 != b1 || !mark || p2 != b2)
+    {
+indent();std::cout << "Failed! protect returned " << p1 << " mark " << mark << ", " << p2 << std::endl;
+    }
+    auto snapshot = hpdom->snapshot();
+    if (!snapshot.search(b1) || !snapshot.search(b2))
+    {
+indent();std::cout << "Failed! protected pointers not in the snapshot" << std::endl;
+    }
+    hpc.store(0, static_cast<B*>(nullptr));
+    hpc.store(1, static_cast<B*>(nullptr));
+    delete b1;
+    delete b2;
+}
+
+struct  C
+{
+    unsigned v;
+    explicit C(unsigned x):v(x) {}
+    ~C()
+    {
+        ++b_dtor_count;
+    }
+};
+
+// Domains of different types sharing a type agnostic domain,
+// share hazard pointers and delete lists.
+void test9()
+{
+indent();std::cout << "test9 domains of different types sharing a hazptr_domain." << std::endl;
+    unsigned dtor_base = b_dtor_count;
+    auto shared = benedias::concurrent::hazptr_domain::make();
+    auto bdom = hazard_pointer_domain<B>::make(shared);
+    {
+        auto cdom = hazard_pointer_domain<C>::make(shared);
+        {
+            auto bhpc = hazard_pointer_context<B, 3, 4>(bdom);
+            auto chpc = hazard_pointer_context<C, 3, 4>(cdom);
+            if (bdom->hazard_pointer_count() != cdom->hazard_pointer_count())
+            {
+indent();std::cout << "Failed! hazard pointers are not shared" << std::endl;
+            }
+            B* b = new B(1);
+            bhpc.store(0, b);
+            bhpc.delete_item(b);
+            for(unsigned i=0; i < 3; ++i)
+            {
+                chpc.delete_item(new C(i));
+            }
+            bhpc.store(0, static_cast<B*>(nullptr));
+        }
+        // Destroyed contexts queue their deleted items on the shared
+        // delete list, which is collected by either domain.
+        bdom->collect();
+        if (b_dtor_count - dtor_base != 4)
+        {
+indent();std::cout << "Failed! reclaimed " << b_dtor_count - dtor_base << " of 4" << std::endl;
+        }
+        auto chpc = hazard_pointer_context<C, 3, 4>(cdom);
+        C* c = new C(4);
+        chpc.store(0, c);
+        chpc.delete_item(c);
+        chpc.store(0, static_cast<C*>(nullptr));
+    }
+    if (b_dtor_count - dtor_base != 5)
+    {
+indent();std::cout << "Failed! items not reclaimed on domain destruction" << std::endl;
+    }
+}
+
+// Allocator freeing many objects at once, counts the calls.
+unsigned batch_deallocations = 0;
+unsigned batch_deallocated = 0;
+struct batch_allocator
+{
+    void deallocate(C* p, std::size_t n)
+    {
+        ::operator delete(p);
+    }
+
+    void deallocate_batch(C** ptrs, std::size_t count)
+    {
+        ++batch_deallocations;
+        batch_deallocated += count;
+        for(std::size_t ix = 0; ix < count; ++ix)
+        {
+            ::operator delete(ptrs[ix]);
+        }
+    }
+};
+
+// Reclamation frees objects in batches, using deallocate_batch.
+void test10()
+{
+indent();std::cout << "test10 batched reclamation." << std::endl;
+    unsigned dtor_base = b_dtor_count;
+    constexpr unsigned count = 300;
+    {
+        auto hpdom = hazard_pointer_domain<C, batch_allocator>::make();
+        {
+            auto hpc = hazard_pointer_context<C, 3, 4, batch_allocator>(hpdom);
+            for(unsigned i=0; i < count; ++i)
+            {
+                hpc.delete_item(new C(i));
+            }
+        }
+        // The second context leaves its deleted items on the domain delete list.
+        auto hpc = hazard_pointer_context<C, 3, 4, batch_allocator>(hpdom);
+        C* c = new C(count);
+        hpc.store(0, c);
+        for(unsigned i=0; i < count; ++i)
+        {
+            hpc.delete_item(i ? new C(i) : c);
+        }
+        hpc.store(0, static_cast<C*>(nullptr));
+    }
+indent();std::cout << batch_deallocated << " objects freed by " << batch_deallocations
+        << " calls" << std::endl;
+    if (b_dtor_count - dtor_base != 2 * count || batch_deallocated != 2 * count)
+    {
+indent();std::cout << "Failed! reclaimed " << b_dtor_count - dtor_base
+            << ", batch freed " << batch_deallocated << " of " << 2 * count << std::endl;
+    }
+    if (batch_deallocations * 4 > 2 * count)
+    {
+indent();std::cout << "Failed! objects were not reclaimed in batches" << std::endl;
+    }
+}
+
+// Past the retired budget, enqueuing collects synchronously,
+// objects protected by a stalled reader keep the domain over budget.
+void test11()
+{
+indent();std::cout << "test11 retired budget." << std::endl;
+    unsigned dtor_base = b_dtor_count;
+    auto hpdom = hazard_pointer_domain<C>::make();
+    hpdom->set_retired_budget(16, 0);
+    std::size_t max_retired = 0;
+    for(unsigned i=0; i < 100; ++i)
+    {
+        hpdom->enqueue_for_delete(new C(i));
+        max_retired = std::max(max_retired, hpdom->retired_count());
+    }
+    if (max_retired > 16 || hpdom->over_retired_budget())
+    {
+indent();std::cout << "Failed! " << max_retired << " retired objects, budget 16" << std::endl;
+    }
+
+    // A stalled reader.
+    auto hpc = hazard_pointer_context<C, 3, 4>(hpdom);
+    std::array<C*, 20> protected_items;
+    hpdom->set_retired_budget(0, 10 * sizeof(C));
+    for(unsigned i=0; i < protected_items.size(); ++i)
+    {
+        protected_items[i] = new C(i);
+    }
+    for(unsigned i=0; i < protected_items.size(); ++i)
+    {
+        hpc.store(i % 3, protected_items[i]);
+        hpdom->enqueue_for_delete(protected_items[i]);
+    }
+indent();std::cout << hpdom->retired_count() << " retired objects, "
+        << hpdom->retired_bytes() << " bytes" << std::endl;
+    if (hpdom->retired_count() < 3 || hpdom->over_retired_budget())
+    {
+indent();std::cout << "Failed! unexpected number of retired objects" << std::endl;
+    }
+    hpdom->set_retired_budget(0, 2 * sizeof(C));
+    if (!hpdom->over_retired_budget())
+    {
+indent();std::cout << "Failed! protected objects are over budget" << std::endl;
+    }
+    for(unsigned i=0; i < 3; ++i)
+    {
+        hpc.store(i, static_cast<C*>(nullptr));
+    }
+    hpdom->collect();
+    if (b_dtor_count - dtor_base != 100 + protected_items.size())
+    {
+indent();std::cout << "Failed! objects not reclaimed" << std::endl;
+    }
+}
+
+// Takes a snapshot when the thread exits, after the thread's snapshot
+// storage has been freed.
+struct exit_snapshot
+{
+    std::shared_ptr<hazard_pointer_domain<B>> hpdom;
+    B* item = nullptr;
+    bool* found = nullptr;
+
+    ~exit_snapshot()
+    {
+        if (hpdom)
+        {
+            auto snapshot = hpdom->snapshot();
+            *found = snapshot.search(item);
+        }
+    }
+};
+
+// Snapshots taken by thread local objects destroyed at thread exit.
+void test12()
+{
+indent();std::cout << "test12 snapshots at thread exit." << std::endl;
+    auto hpdom = hazard_pointer_domain<B>::make();
+    B item(1);
+    bool found = false;
+    auto hpc = hazard_pointer_context<B, 3, 0>(hpdom);
+    hpc.store(0, &item);
+    std::thread([&]()
+        {
+            // Constructed before the snapshot storage is used,
+            // so destroyed after it is freed.
+            static thread_local exit_snapshot at_exit;
+            at_exit.hpdom = hpdom;
+            at_exit.item = &item;
+            at_exit.found = &found;
+            auto snapshot = hpdom->snapshot();
+        }).join();
+    if (!found)
+    {
+indent();std::cout << "Failed! snapshot at thread exit" << std::endl;
+    }
+    hpc.store(0, static_cast<B*>(nullptr));
+}
 
 int main( int argc, char* argv[] )
 {
     typedef void(*testfuncptr)();
-    std::array<testfuncptr, 4> testfuncs{{test0, test1, test2, test3}};
+    std::array<testfuncptr, 13> testfuncs{{test0, test1, test2, test3, test4, test5, test6, test7, test8, test9, test10, test11, test12}};
 //    std::array<testfuncptr, 4> testfuncs{{test0}};
     std::setlocale(LC_ALL, "en_US.UTF-8");
     std::srand(std::time(nullptr)); // use current time as seed for random generator
@@ -21,6 +21,7 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <atomic>
 #include <cassert>
+#include <cstdint>
 
 namespace benedias {
 namespace concurrent {
@@ -28,31 +29,67 @@ namespace concurrent {
 constexpr   uintptr_t   mark_bits_mask=1;
 constexpr   uintptr_t   mark_bits_maskoff=~mark_bits_mask;
 
+/// A pointer with a mark bit, the lsb, updated atomically as one word.
+/// Loads default to acquire, so that nodes reached by traversal are
+/// initialised, pass __ATOMIC_RELAXED where a validating load follows.
+/// CAS operations default to __ATOMIC_ACQ_REL on success and
+/// __ATOMIC_RELAXED on failure, the order parameters take the
+/// __ATOMIC_* values.
+/// CAS_weak may fail spuriously, it is for use in retry loops,
+/// where it avoids the nested loop strong CAS requires on LL/SC
+/// architectures (ARM).
 template <typename T> class mark_ptr_type
 {
     private:
         uintptr_t   upv = 0;
+
+        static inline uintptr_t make_pv(T* p, bool mark)
+        {
+            return reinterpret_cast<uintptr_t>(p) | (mark ? mark_bits_mask : 0);
+        }
+
     public:
 
+    /// Set the pointer, preserving the mark.
+    /// This is not a read-modify-write operation, it is for nodes which
+    /// are not yet shared or are owned by the caller, so the store is
+    /// relaxed, the node is published by a subsequent release operation.
     inline void operator=(T* p)
     {
-        upv = reinterpret_cast<uintptr_t>(p) | (upv & mark_bits_mask);
+        store(p, __ATOMIC_RELAXED);
     }
 
-    inline T* operator()(bool *mark)
+    inline void store(T* p, int order=__ATOMIC_RELEASE)
     {
-        *mark = (0 != (upv & mark_bits_mask));
-        return reinterpret_cast<T*>(upv & mark_bits_maskoff);
+        uintptr_t mark = __atomic_load_n(&upv, __ATOMIC_RELAXED) & mark_bits_mask;
+        __atomic_store_n(&upv, reinterpret_cast<uintptr_t>(p) | mark, order);
     }
 
-    inline T* operator()()
+    inline T* load(bool *mark, int order=__ATOMIC_ACQUIRE) const
     {
-        return reinterpret_cast<T*>(upv & mark_bits_maskoff);
+        uintptr_t v = __atomic_load_n(&upv, order);
+        *mark = (0 != (v & mark_bits_mask));
+        return reinterpret_cast<T*>(v & mark_bits_maskoff);
     }
 
-    inline T* operator->()
+    inline T* load(int order=__ATOMIC_ACQUIRE) const
     {
-        return reinterpret_cast<T*>(upv & mark_bits_maskoff);
+        return reinterpret_cast<T*>(__atomic_load_n(&upv, order) & mark_bits_maskoff);
+    }
+
+    inline T* operator()(bool *mark) const
+    {
+        return load(mark);
+    }
+
+    inline T* operator()() const
+    {
+        return load();
+    }
+
+    inline T* operator->() const
+    {
+        return load();
     }
 
     inline T** address()
@@ -69,69 +106,208 @@ template <typename T> class mark_ptr_type
         upv =  reinterpret_cast<uintptr_t>(p);
     }
 
-    inline bool CAS(T* expected, T* desired)
+    /// Replace the unmarked expected with desired, marked if mark is set.
+    inline bool CAS(T* expected, T* desired, bool mark=false,
+            int success=__ATOMIC_ACQ_REL, int failure=__ATOMIC_RELAXED)
     {
-        uintptr_t pv_expected = reinterpret_cast<uintptr_t>(expected);
-        uintptr_t pv_desired = reinterpret_cast<uintptr_t>(desired);
-        return __atomic_compare_exchange(&upv, &pv_expected, &pv_desired,
-                   false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        uintptr_t pv_expected = make_pv(expected, false);
+        return __atomic_compare_exchange_n(&upv, &pv_expected, make_pv(desired, mark),
+                   false, success, failure);
     }
 
-    inline bool CAS(T* expected, T* desired, bool mark)
+    inline bool CAS_weak(T* expected, T* desired, bool mark=false,
+            int success=__ATOMIC_ACQ_REL, int failure=__ATOMIC_RELAXED)
     {
-        uintptr_t pv_expected = reinterpret_cast<uintptr_t>(expected);
-        uintptr_t pv_desired = reinterpret_cast<uintptr_t>(desired);
-        if (mark)
-        {
-            pv_desired |= mark_bits_mask;
-        }
-        return __atomic_compare_exchange(&upv, &pv_expected, &pv_desired,
-                   false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        uintptr_t pv_expected = make_pv(expected, false);
+        return __atomic_compare_exchange_n(&upv, &pv_expected, make_pv(desired, mark),
+                   true, success, failure);
     }
 
-    inline bool CAS(T* expected, bool mark)
+    /// Set the mark, if the pointer is the unmarked expected.
+    inline bool CAS(T* expected, bool mark,
+            int success=__ATOMIC_ACQ_REL, int failure=__ATOMIC_RELAXED)
     {
-        uintptr_t pv_expected = reinterpret_cast<uintptr_t>(expected);
-        uintptr_t pv_desired = reinterpret_cast<uintptr_t>(expected);
-        if (mark)
-        {
-            pv_desired |= mark_bits_mask;
-        }
-        return __atomic_compare_exchange(&upv, &pv_expected, &pv_desired,
-                   false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        return CAS(expected, expected, mark, success, failure);
     }
 
-    inline bool mark()
+    /// \@return true if the mark was set by this call.
+    inline bool mark(int order=__ATOMIC_ACQ_REL)
     {
-        uintptr_t v = __atomic_fetch_or(&upv, mark_bits_mask, __ATOMIC_ACQ_REL);
+        uintptr_t v = __atomic_fetch_or(&upv, mark_bits_mask, order);
         return (0 == (mark_bits_mask & v));
     }
 
-    inline bool CAS(T* expected, bool marked, T* desired, bool mark)
+    inline bool CAS(T* expected, bool marked, T* desired, bool mark,
+            int success=__ATOMIC_ACQ_REL, int failure=__ATOMIC_RELAXED)
     {
-        uintptr_t pv_expected = reinterpret_cast<uintptr_t>(expected);
-        uintptr_t pv_desired = reinterpret_cast<uintptr_t>(desired);
+        uintptr_t pv_expected = make_pv(expected, marked);
+        return __atomic_compare_exchange_n(&upv, &pv_expected, make_pv(desired, mark),
+                   false, success, failure);
+    }
+
+    inline bool CAS_weak(T* expected, bool marked, T* desired, bool mark,
+            int success=__ATOMIC_ACQ_REL, int failure=__ATOMIC_RELAXED)
+    {
+        uintptr_t pv_expected = make_pv(expected, marked);
+        return __atomic_compare_exchange_n(&upv, &pv_expected, make_pv(desired, mark),
+                   true, success, failure);
+    }
 
-        if (marked)
+    inline void reset()
+    {
+        __atomic_store_n(&upv, 0, __ATOMIC_RELAXED);
+    }
+
+    ~mark_ptr_type() = default;
+};
+
+/// A mark_ptr_type with a version, incremented by every update, so that
+/// CAS fails if the pointer changed and changed back (ABA), for example
+/// when the node pointed to was freed and its memory reused.
+/// The version only makes updates safe, nodes must still be protected
+/// (hazard pointers, epochs) to be dereferenced.
+/// On 64 bit targets user space addresses fit in the low 48 bits, and
+/// the version is in the upper 16 bits, so it wraps after 65536 updates.
+/// On 32 bit targets the pointer and a 32 bit version are packed
+/// into 64 bits, so 64 bit atomic operations must be lock free.
+/// Not used by solist, whose nodes are protected until reclaimed,
+/// it is a building block for containers which reuse nodes.
+template <typename T> class tagged_mark_ptr
+{
+    static_assert(__atomic_always_lock_free(sizeof(uint64_t), 0),
+            "tagged_mark_ptr requires lock free 64 bit atomic operations");
+
+    public:
+#if UINTPTR_MAX == UINT64_MAX
+    static constexpr unsigned version_shift = 48;
+#else
+    static constexpr unsigned version_shift = 32;
+#endif
+    static constexpr uint64_t pv_mask = (uint64_t(1) << version_shift) - 1;
+
+    /// A value loaded, the expected value for CAS.
+    class snapshot
+    {
+        uint64_t    tv;
+        friend class tagged_mark_ptr;
+        explicit snapshot(uint64_t v):tv(v) {}
+
+        public:
+        inline T* ptr() const
+        {
+            return reinterpret_cast<T*>(static_cast<uintptr_t>(tv & pv_mask & mark_bits_maskoff));
+        }
+
+        inline T* ptr(bool* mark) const
         {
-            pv_expected |= mark_bits_mask;
+            *mark = marked();
+            return ptr();
         }
 
-        if (mark)
+        inline bool marked() const
         {
-            pv_desired |= mark_bits_mask;
+            return 0 != (tv & mark_bits_mask);
         }
 
-        return __atomic_compare_exchange(&upv, &pv_expected, &pv_desired,
-                   false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+        inline uint64_t version() const
+        {
+            return tv >> version_shift;
+        }
+    };
+
+    private:
+        // Aligned for 64 bit atomic operations on 32 bit targets.
+        alignas(8) uint64_t    tv = 0;
+
+        // The next version of tv, with the pointer and mark replaced.
+        static inline uint64_t next_tv(uint64_t tv, T* p, bool mark)
+        {
+            uint64_t pv = reinterpret_cast<uintptr_t>(p) | (mark ? mark_bits_mask : 0);
+            assert(0 == (pv & ~pv_mask));
+            return (((tv >> version_shift) + 1) << version_shift) | pv;
+        }
+
+    public:
+    explicit tagged_mark_ptr()
+    {
+    }
+
+    explicit tagged_mark_ptr(T* p):tv(reinterpret_cast<uintptr_t>(p))
+    {
+    }
+
+    inline snapshot load(int order=__ATOMIC_ACQUIRE) const
+    {
+        return snapshot(__atomic_load_n(&tv, order));
+    }
+
+    inline T* operator()(bool *mark) const
+    {
+        return load().ptr(mark);
+    }
+
+    inline T* operator()() const
+    {
+        return load().ptr();
+    }
+
+    inline T* operator->() const
+    {
+        return load().ptr();
+    }
+
+    /// Set the pointer, preserving the mark, as mark_ptr_type::operator=,
+    /// this is not a read-modify-write operation.
+    inline void operator=(T* p)
+    {
+        store(p, __ATOMIC_RELAXED);
+    }
+
+    inline void store(T* p, int order=__ATOMIC_RELEASE)
+    {
+        uint64_t v = __atomic_load_n(&tv, __ATOMIC_RELAXED);
+        __atomic_store_n(&tv, next_tv(v, p, 0 != (v & mark_bits_mask)), order);
+    }
+
+    /// Replace expected, including its version, with desired,
+    /// marked if mark is set.
+    inline bool CAS(const snapshot& expected, T* desired, bool mark=false,
+            int success=__ATOMIC_ACQ_REL, int failure=__ATOMIC_RELAXED)
+    {
+        uint64_t v = expected.tv;
+        return __atomic_compare_exchange_n(&tv, &v, next_tv(v, desired, mark),
+                false, success, failure);
+    }
+
+    inline bool CAS_weak(const snapshot& expected, T* desired, bool mark=false,
+            int success=__ATOMIC_ACQ_REL, int failure=__ATOMIC_RELAXED)
+    {
+        uint64_t v = expected.tv;
+        return __atomic_compare_exchange_n(&tv, &v, next_tv(v, desired, mark),
+                true, success, failure);
+    }
+
+    /// \@return true if the mark was set by this call.
+    inline bool mark(int order=__ATOMIC_ACQ_REL)
+    {
+        uint64_t v = __atomic_load_n(&tv, __ATOMIC_RELAXED);
+        do
+        {
+            if (0 != (v & mark_bits_mask))
+            {
+                return false;
+            }
+        }while(!__atomic_compare_exchange_n(&tv, &v, next_tv(v, snapshot(v).ptr(), true),
+                    true, order, __ATOMIC_RELAXED));
+        return true;
     }
-    
+
     inline void reset()
     {
-        upv = 0;
+        __atomic_store_n(&tv, 0, __ATOMIC_RELAXED);
     }
 
-    ~mark_ptr_type() = default;
+    ~tagged_mark_ptr() = default;
 };
 
 } // namespace concurrent
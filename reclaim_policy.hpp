@@ -0,0 +1,393 @@
+/*
+
+Copyright (C) 2019  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENEDIAS_RECLAIM_POLICY_HPP
+#define BENEDIAS_RECLAIM_POLICY_HPP
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "mark_ptr_type.hpp"
+#include "hazard_pointer.hpp"
+
+/// Memory reclamation policies for lock free containers.
+/// Hazard pointers publish every node traversed, epoch based
+/// reclamation announces once per operation, quiescent state based
+/// reclamation announces once per operation without a fence, but
+/// reclamation stalls while any thread using the container is idle.
+///
+/// A reclamation policy is a class with
+///     - a nested type shared_state, one instance of which is shared by
+///       all threads accessing the same data structure, constructible from
+///       (std::shared_ptr<hazptr_reclaimer>, std::shared_ptr<hazptr_domain>),
+///       hazard pointer options which other policies ignore,
+///       with member functions
+///         void set_retired_budget(max_objects, max_bytes, object_size)
+///         bool over_retired_budget() const
+///     - a constructor taking a reference to the shared_state.
+///     - void begin(), invoked at the start of every operation.
+///     - void end(), invoked at the end of an operation, pointers obtained
+///       are not safe after this.
+///     - T* protect(index, const mark_ptr_type<T>& src, bool* mark),
+///       load from src, the node pointed to is safe until end, or until
+///       index is reused, the returned pointer is unmarked.
+///     - void hold(index, T* ptr), keep a node obtained using protect
+///       safe, under a different index.
+///     - void retire(T* ptr), the node has been unlinked, reclaim it
+///       when it is safe.
+/// Policy instances are per thread.
+namespace benedias {
+    namespace concurrent {
+
+        /// Hazard pointers, S per thread, R is the minimum number of
+        /// retired nodes held before a scan.
+        template <typename T, std::size_t S, std::size_t R, class Allocator=std::allocator<T>>
+            class reclaim_hazard_pointers
+        {
+            public:
+            struct shared_state
+            {
+                std::shared_ptr<hazard_pointer_domain<T, Allocator>> domain;
+
+                explicit shared_state(std::shared_ptr<hazptr_reclaimer> reclaimer=nullptr,
+                        std::shared_ptr<hazptr_domain> shared_domain=nullptr):
+                    domain(hazard_pointer_domain<T, Allocator>::make(reclaimer, shared_domain))
+                {
+                }
+
+                void set_retired_budget(std::size_t max_objects, std::size_t max_bytes,
+                        std::size_t object_size)
+                {
+                    domain->set_retired_budget(max_objects, max_bytes, object_size);
+                }
+
+                inline bool over_retired_budget() const
+                {
+                    return domain->over_retired_budget();
+                }
+            };
+
+            private:
+            hazard_pointer_context<T, S, R, Allocator> context;
+
+            public:
+            explicit reclaim_hazard_pointers(shared_state& state):context(state.domain) {}
+
+            inline void begin() {}
+
+            inline void end()
+            {
+                for(std::size_t ix = 0; ix < S; ++ix)
+                {
+                    context.store(ix, static_cast<T*>(nullptr));
+                }
+            }
+
+            inline T* protect(std::size_t index, const mark_ptr_type<T>& src, bool* mark)
+            {
+                return context.protect(index, src, mark);
+            }
+
+            inline void hold(std::size_t index, T* ptr)
+            {
+                context.store(index, ptr);
+            }
+
+            inline void retire(T* ptr)
+            {
+                context.delete_item(ptr);
+            }
+        };
+
+        /// Per thread announcement of an epoch based policy.
+        struct alignas(HAZPTR_CACHE_LINE) reclaim_epoch_record
+        {
+            /// (epoch << 1) | 1, or 0 if not in an operation (EBR only).
+            uint64_t    announce = 0;
+            bool        in_use = true;
+            reclaim_epoch_record* next = nullptr;
+        };
+
+        /// Epoch based reclamation, EBR if Quiescent is false, otherwise
+        /// quiescent state based reclamation, QSBR.
+        /// Nodes retired in epoch e are reclaimed when the global epoch
+        /// reaches e + 2. The global epoch is advanced when every thread
+        /// has announced the current epoch,
+        ///     EBR - at the start of operations, threads not in an operation
+        ///           do not hold back the epoch.
+        ///     QSBR - at the end of operations, every thread using the
+        ///           container must complete operations for the epoch to
+        ///           advance.
+        /// R is the number of nodes retired between attempts to reclaim.
+        template <typename T, std::size_t R, class Allocator, bool Quiescent> class reclaim_epoch_based
+        {
+            public:
+            struct shared_state
+            {
+                uint64_t    epoch = 1;
+                // Records are reused, and only deleted with the shared state.
+                reclaim_epoch_record* records = nullptr;
+                // Nodes retired by threads which have stopped using the
+                // container, with their epochs.
+                std::mutex  orphans_mutex;
+                std::vector<std::pair<uint64_t, T*>> orphans;
+                std::size_t n_orphans = 0;
+                // Retired nodes not yet reclaimed, updated at scans.
+                std::size_t retired = 0;
+                std::size_t budget_objects = 0;
+                std::size_t budget_bytes = 0;
+                std::size_t object_size = sizeof(T);
+                Allocator   allocator;
+
+                // Non copyable
+                shared_state& operator=(const shared_state&) = delete;
+                shared_state(shared_state const&) = delete;
+
+                explicit shared_state(std::shared_ptr<hazptr_reclaimer> reclaimer=nullptr,
+                        std::shared_ptr<hazptr_domain> shared_domain=nullptr)
+                {
+                    // Publication fences are shared with hazard pointers.
+                    hazard_pointer_global_init();
+                }
+
+                ~shared_state()
+                {
+                    // No thread is using the container.
+                    for(auto& orphan: orphans)
+                    {
+                        hazptr_destroy_objects(allocator, &orphan.second, 1);
+                    }
+                    for(auto r = records; nullptr != r; )
+                    {
+                        assert(!r->in_use);
+                        auto rnext = r->next;
+                        delete r;
+                        r = rnext;
+                    }
+                }
+
+                /// Reuse a free record or add a new one, lock-free.
+                reclaim_epoch_record* acquire_record()
+                {
+                    for(auto r = __atomic_load_n(&records, __ATOMIC_ACQUIRE); nullptr != r; r = r->next)
+                    {
+                        bool expected = false;
+                        if (!__atomic_load_n(&r->in_use, __ATOMIC_RELAXED)
+                                && __atomic_compare_exchange_n(&r->in_use, &expected, true,
+                                    false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                        {
+                            return r;
+                        }
+                    }
+                    auto r = new reclaim_epoch_record();
+                    r->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+                    while(!__atomic_compare_exchange_n(&records, &r->next, r,
+                                false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                    {
+                    }
+                    return r;
+                }
+
+                /// Advance the global epoch if every thread has announced it.
+                void try_advance()
+                {
+                    uint64_t e = __atomic_load_n(&epoch, __ATOMIC_ACQUIRE);
+                    // Announcements made before this point must be visible.
+                    hazptr_scan_fence();
+                    for(auto r = __atomic_load_n(&records, __ATOMIC_ACQUIRE); nullptr != r; r = r->next)
+                    {
+                        if (!__atomic_load_n(&r->in_use, __ATOMIC_ACQUIRE))
+                        {
+                            continue;
+                        }
+                        uint64_t a = __atomic_load_n(&r->announce, __ATOMIC_ACQUIRE);
+                        if (Quiescent ? a != ((e << 1) | 1) : (0 != a && a != ((e << 1) | 1)))
+                        {
+                            return;
+                        }
+                    }
+                    __atomic_compare_exchange_n(&epoch, &e, e + 1,
+                            false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+                }
+
+                /// Reclaim orphaned nodes which are safe, if no other
+                /// thread is doing so.
+                void reclaim_orphans()
+                {
+                    if (0 == __atomic_load_n(&n_orphans, __ATOMIC_RELAXED))
+                    {
+                        return;
+                    }
+                    std::unique_lock<std::mutex> lock(orphans_mutex, std::try_to_lock);
+                    if (!lock.owns_lock())
+                    {
+                        return;
+                    }
+                    uint64_t e = __atomic_load_n(&epoch, __ATOMIC_ACQUIRE);
+                    std::size_t kept = 0;
+                    for(auto& orphan: orphans)
+                    {
+                        if (orphan.first + 2 <= e)
+                        {
+                            hazptr_destroy_objects(allocator, &orphan.second, 1);
+                        }
+                        else
+                        {
+                            orphans[kept++] = orphan;
+                        }
+                    }
+                    __atomic_sub_fetch(&retired, orphans.size() - kept, __ATOMIC_RELAXED);
+                    orphans.resize(kept);
+                    __atomic_store_n(&n_orphans, kept, __ATOMIC_RELAXED);
+                }
+
+                void set_retired_budget(std::size_t max_objects, std::size_t max_bytes,
+                        std::size_t size)
+                {
+                    budget_objects = max_objects;
+                    budget_bytes = max_bytes;
+                    object_size = size;
+                }
+
+                inline bool over_retired_budget() const
+                {
+                    std::size_t count = __atomic_load_n(&retired, __ATOMIC_RELAXED);
+                    return (0 != budget_objects && count > budget_objects)
+                        || (0 != budget_bytes && count * object_size > budget_bytes);
+                }
+            };
+
+            private:
+            shared_state&   shared;
+            reclaim_epoch_record* const record;
+            // Retired nodes with the epoch in which they were retired.
+            std::vector<std::pair<uint64_t, T*>> retired;
+            std::vector<T*> batch;
+            // Nodes retired since the last scan.
+            std::size_t unscanned = 0;
+
+            void scan()
+            {
+                __atomic_add_fetch(&shared.retired, unscanned, __ATOMIC_RELAXED);
+                unscanned = 0;
+                shared.try_advance();
+                uint64_t e = __atomic_load_n(&shared.epoch, __ATOMIC_ACQUIRE);
+                std::size_t kept = 0;
+                batch.clear();
+                for(auto& item: retired)
+                {
+                    if (item.first + 2 <= e)
+                    {
+                        batch.push_back(item.second);
+                    }
+                    else
+                    {
+                        retired[kept++] = item;
+                    }
+                }
+                retired.resize(kept);
+                hazptr_destroy_objects(shared.allocator, batch.data(), batch.size());
+                __atomic_sub_fetch(&shared.retired, batch.size(), __ATOMIC_RELAXED);
+                shared.reclaim_orphans();
+            }
+
+            public:
+            // Non copyable
+            reclaim_epoch_based& operator=(const reclaim_epoch_based&) = delete;
+            reclaim_epoch_based(reclaim_epoch_based const&) = delete;
+
+            explicit reclaim_epoch_based(shared_state& state):
+                shared(state), record(state.acquire_record())
+            {
+                retired.reserve(R);
+                batch.reserve(R);
+                uint64_t e = __atomic_load_n(&shared.epoch, __ATOMIC_ACQUIRE);
+                __atomic_store_n(&record->announce, Quiescent ? ((e << 1) | 1) : 0, __ATOMIC_RELEASE);
+            }
+
+            ~reclaim_epoch_based()
+            {
+                __atomic_store_n(&record->announce, 0, __ATOMIC_RELEASE);
+                __atomic_store_n(&record->in_use, false, __ATOMIC_RELEASE);
+                __atomic_add_fetch(&shared.retired, unscanned, __ATOMIC_RELAXED);
+                if (!retired.empty())
+                {
+                    // FIXME: blocking.
+                    std::lock_guard<std::mutex> lock(shared.orphans_mutex);
+                    shared.orphans.insert(shared.orphans.end(), retired.begin(), retired.end());
+                    __atomic_store_n(&shared.n_orphans, shared.orphans.size(), __ATOMIC_RELAXED);
+                }
+            }
+
+            inline void begin()
+            {
+                if (!Quiescent)
+                {
+                    uint64_t e = __atomic_load_n(&shared.epoch, __ATOMIC_ACQUIRE);
+                    __atomic_store_n(&record->announce, (e << 1) | 1, __ATOMIC_RELAXED);
+                    // The announcement must be visible to reclaimers
+                    // before nodes are loaded.
+                    hazptr_publish_fence();
+                }
+            }
+
+            inline void end()
+            {
+                if (Quiescent)
+                {
+                    // Announce a quiescent state, after the loads of the operation.
+                    uint64_t e = __atomic_load_n(&shared.epoch, __ATOMIC_ACQUIRE);
+                    __atomic_store_n(&record->announce, (e << 1) | 1, __ATOMIC_RELEASE);
+                }
+                else
+                {
+                    __atomic_store_n(&record->announce, 0, __ATOMIC_RELEASE);
+                }
+            }
+
+            inline T* protect(std::size_t index, const mark_ptr_type<T>& src, bool* mark)
+            {
+                return src(mark);
+            }
+
+            inline void hold(std::size_t index, T* ptr) {}
+
+            inline void retire(T* ptr)
+            {
+                // The epoch must be read after the unlinking CAS, which
+                // may be a release operation.
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                retired.emplace_back(__atomic_load_n(&shared.epoch, __ATOMIC_RELAXED), ptr);
+                // Past the budget, reclaim on every retirement.
+                if (++unscanned >= R || shared.over_retired_budget())
+                {
+                    scan();
+                }
+            }
+        };
+
+        template <typename T, std::size_t R, class Allocator=std::allocator<T>>
+            using reclaim_epoch = reclaim_epoch_based<T, R, Allocator, false>;
+
+        template <typename T, std::size_t R, class Allocator=std::allocator<T>>
+            using reclaim_qsbr = reclaim_epoch_based<T, R, Allocator, true>;
+
+    } //namespace concurrent
+} //namespace benedias
+#endif // #define BENEDIAS_RECLAIM_POLICY_HPP
@@ -19,11 +19,22 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef BENEDIAS_SOLIST_HPP
 #define BENEDIAS_SOLIST_HPP
 #include <atomic>
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <utility>
 #include <memory>
+#include <new>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <random>
 #include "mark_ptr_type.hpp"
+#include "hazard_pointer.hpp"
+#include "reclaim_policy.hpp"
+#include "backoff.hpp"
 #if 1
 #include <iostream>
 #include <cstdio>
@@ -66,6 +77,10 @@ namespace benedias {
 
         solist_bucket() {}
 
+        // For data nodes, the bucket key derivation would reject hash
+        // values with the msb set.
+        solist_bucket(hash_t hashv, so_key key):hashv(hashv),key(key){}
+
         public:
         hash_t          hashv;
         so_key          key;
@@ -76,6 +91,13 @@ namespace benedias {
         {
             return DATABIT == (key & DATABIT);
         }
+
+        // Nodes are ordered by key, then by hash value, since hash values
+        // differing only in the msb have the same key.
+        inline bool precedes(so_key k, hash_t h)
+        {
+            return key < k || (key == k && hashv <= h);
+        }
         virtual ~solist_bucket() = default;
     };
 
@@ -91,15 +113,61 @@ namespace benedias {
         solist_node& operator=(solist_node&&) = delete;
         solist_node(solist_node&&) = delete;
 
-        explicit solist_node(T data, hash_t hashv):solist_bucket(hashv),payload(data)
+        explicit solist_node(T data, hash_t hashv):solist_bucket(hashv, sol_node_key(hashv)),payload(data)
         {
-            key |= DATABIT;
         }
         T*              get_item_ptr() { return &payload; }
         ~solist_node() = default;
 
     };
 
+    // Deallocation of nodes reclaimed through the hazard pointer domain.
+    // The domain runs the (virtual) destructor, nodes are allocated using
+    // new as either solist_bucket or solist_node<T>, so the allocation
+    // size is not known at this point.
+    struct solist_bucket_allocator
+    {
+        inline void deallocate(solist_bucket* p, std::size_t n)
+        {
+            ::operator delete(p);
+        }
+    };
+
+    // Retired nodes are linked on delete lists through next.
+    // Only marked nodes are unlinked and retired, traversals holding
+    // hazard pointers to a retired node see the mark and restart,
+    // so the mark must be preserved, the pointer is never followed.
+    template <> struct hazptr_retire_link<solist_bucket>
+    {
+        static constexpr bool intrusive = true;
+        static inline solist_bucket* get(solist_bucket* node)
+        {
+            return node->next();
+        }
+        static inline void set(solist_bucket* node, solist_bucket* link)
+        {
+            node->next = link;
+        }
+    };
+
+    // Minimum number of deleted nodes an accessor holds, before attempting
+    // reclamation, accessors scan when their list of deleted nodes
+    // reaches max(SOLIST_RETIRE_BATCH, HAZPTR_SCAN_FACTOR * H).
+    constexpr std::size_t SOLIST_RETIRE_BATCH = 32;
+
+    /// Reclamation policies for deleted nodes, see reclaim_policy.hpp.
+    /// Hazard pointers, the default, bound the number of unreclaimed nodes
+    /// but fence on every node traversed.
+    using solist_reclaim_hazard_pointers = reclaim_hazard_pointers<solist_bucket, 3,
+          SOLIST_RETIRE_BATCH, solist_bucket_allocator>;
+    /// Epoch based reclamation, one fence per operation.
+    using solist_reclaim_epoch = reclaim_epoch<solist_bucket,
+          SOLIST_RETIRE_BATCH, solist_bucket_allocator>;
+    /// Quiescent state based reclamation, no fences, but every accessor
+    /// must keep performing operations for nodes to be reclaimed.
+    using solist_reclaim_qsbr = reclaim_qsbr<solist_bucket,
+          SOLIST_RETIRE_BATCH, solist_bucket_allocator>;
+
 #if 0
     template <typename T> class solist_traverse
     {
@@ -111,12 +179,250 @@ namespace benedias {
     };
 #endif
 
-    template <typename T> struct solist
+    /// Hash mixers, applied with a per table random seed to the hash values
+    /// supplied by callers, before the split ordered keys are derived.
+    /// Slots are selected using the low bits of the hash, so without mixing,
+    /// poor hash functions or adversarial key sets can put every item
+    /// into a single bucket.
+    /// A mixer is a class with a static member function
+    ///     hash_t mix(hash_t hashv, hash_t seed)
+
+    /// Use the hash values supplied as is, the seed is ignored.
+    struct hash_mixer_none
+    {
+        static inline hash_t mix(hash_t hashv, hash_t seed)
+        {
+            return hashv;
+        }
+    };
+
+    /// The MurmurHash3 32 bit finaliser (multiply-xorshift) applied to
+    /// the seeded hash value. 
+    /// Every bit of the seeded hash affects the low bits of the result.
+    struct hash_mixer_fmix32
+    {
+        static inline hash_t mix(hash_t hashv, hash_t seed)
+        {
+            hashv ^= seed;
+            hashv ^= hashv >> 16;
+            hashv *= 0x85ebca6b;
+            hashv ^= hashv >> 13;
+            hashv *= 0xc2b2ae35;
+            hashv ^= hashv >> 16;
+            return hashv;
+        }
+    };
+
+    /// Policy for growing the bucket directory and splitting buckets.
+    enum class solist_growth
+    {
+        /// The inserting thread which detects bucket overflow expands the
+        /// directory and initialises the new bucket itself.
+        inline_growth,
+        /// Inserts only signal growth pressure, expansion and bucket
+        /// initialisation is performed by a solist_maintainer thread,
+        /// or by threads calling solist_accessor::maintain() when idle.
+        deferred_growth,
+    };
+
+    // Growth request flags, see solist::request_growth.
+    constexpr uint32_t  SOLIST_GROW_SPLIT = 0x1;
+    constexpr uint32_t  SOLIST_GROW_EXPAND = 0x2;
+
+    // The bucket directory is not expanded past this many slots, chains
+    // of colliding hash values cannot be shortened by expanding, so must
+    // not be able to grow the directory without bound.
+    constexpr uint32_t  SOLIST_MAX_BUCKETS = uint32_t(1) << 24;
+
+    // Flat combining publication record states.
+    // FREE -> PENDING, by the owner once the request is filled in,
+    // PENDING -> COMBINING, by the combiner applying the request,
+    // COMBINING -> DONE, by the combiner once the result is set,
+    // DONE -> FREE, by the owner once the result is read.
+    constexpr uint32_t  SOLIST_REQ_FREE = 0;
+    constexpr uint32_t  SOLIST_REQ_PENDING = 1;
+    constexpr uint32_t  SOLIST_REQ_COMBINING = 2;
+    constexpr uint32_t  SOLIST_REQ_DONE = 3;
+
+    // An insert or delete published for a combiner to apply.
+    // Each record is owned by one accessor at a time, so publishing
+    // a request needs no atomic read-modify-write.
+    template <typename T> struct alignas(64) solist_combine_request
+    {
+        uint32_t    state = SOLIST_REQ_FREE;
+        // Non zero while an accessor owns the record.
+        uint32_t    owned = 1;
+        // Next record, records are never unlinked.
+        solist_combine_request* next_record = nullptr;
+        // Index of the combiner lock serialising the bucket.
+        uint32_t    lock_index;
+        hash_t      hashv;
+        bool        insert;
+        bool        result;
+        // Constructed for inserts only, so T need not be default
+        // constructible.
+        alignas(T) unsigned char payload[sizeof(T)];
+
+        inline T* payload_ptr()
+        {
+            return reinterpret_cast<T*>(payload);
+        }
+    };
+
+    /// Flat combining state for writes to hot buckets.
+    /// Threads whose CAS operations keep failing publish their inserts
+    /// and deletes, one of the threads contending for a bucket takes the
+    /// combiner lock for that bucket and applies the pending requests in a
+    /// single sorted sweep, using the same lock free operations.
+    /// Threads which do not combine are unaffected, so correctness never
+    /// depends on which mode a thread is in.
+    template <typename T> struct solist_combiner
+    {
+        // Maximum number of requests applied in one sweep, requests left
+        // pending are applied by a later sweep.
+        static constexpr unsigned N_BATCH = 64;
+        static constexpr unsigned N_LOCKS = 16;
+
+        struct alignas(64) combiner_lock
+        {
+            uint32_t    held = 0;
+        };
+
+        // CAS failure rate, in 1/256ths, above which an accessor combines.
+        const uint32_t  threshold;
+        // Publication records of accessors, records released by
+        // accessors are reused, so the list is as long as the largest
+        // number of accessors which have combined concurrently.
+        solist_combine_request<T>* records = nullptr;
+        // Combiner locks, buckets are hashed onto the locks.
+        combiner_lock   locks[N_LOCKS];
+
+        // Non copyable
+        solist_combiner& operator=(const solist_combiner&) = delete;
+        solist_combiner(solist_combiner const&) = delete;
+
+        explicit solist_combiner(uint32_t failure_threshold):threshold(failure_threshold){}
+
+        ~solist_combiner()
+        {
+            while(nullptr != records)
+            {
+                auto next = records->next_record;
+                delete records;
+                records = next;
+            }
+        }
+
+        /// Acquire a publication record for the exclusive use of an
+        /// accessor, until it is released.
+        solist_combine_request<T>* acquire_record()
+        {
+            for (auto rec = __atomic_load_n(&records, __ATOMIC_ACQUIRE);
+                    nullptr != rec; rec = rec->next_record)
+            {
+                uint32_t free = 0;
+                if (0 == __atomic_load_n(&rec->owned, __ATOMIC_RELAXED)
+                        && __atomic_compare_exchange_n(&rec->owned, &free, 1,
+                            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                {
+                    return rec;
+                }
+            }
+
+            auto rec = new solist_combine_request<T>();
+            rec->next_record = __atomic_load_n(&records, __ATOMIC_RELAXED);
+            while(!__atomic_compare_exchange_n(&records, &rec->next_record, rec,
+                        true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            {
+            }
+            return rec;
+        }
+
+        /// Release a record, it must not have a request pending.
+        void release_record(solist_combine_request<T>* rec)
+        {
+            __atomic_store_n(&rec->owned, 0, __ATOMIC_RELEASE);
+        }
+
+        inline bool try_lock(uint32_t index)
+        {
+            uint32_t idle = 0;
+            return __atomic_compare_exchange_n(&locks[index].held, &idle, 1,
+                        false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+        }
+
+        inline void unlock(uint32_t index)
+        {
+            __atomic_store_n(&locks[index].held, 0, __ATOMIC_RELEASE);
+        }
+    };
+    /// Flat combining policies, select whether accessors of a solist
+    /// combine their inserts and deletes under contention.
+    /// A policy is a class with the static members
+    ///     bool enabled
+    ///     uint32_t failure_percent, the CAS failure rate at which an
+    ///     accessor starts combining.
+    /// Accessors periodically sample the lock free path, so they return
+    /// to it when contention subsides.
+
+    /// Accessors always use the lock free operations.
+    struct solist_combining_none
+    {
+        static constexpr bool enabled = false;
+        static constexpr uint32_t failure_percent = 100;
+    };
+
+    /// Accessors whose recent CAS failure rate is at least FailurePercent
+    /// combine, 0 makes every accessor combine.
+    template <uint32_t FailurePercent=10> struct solist_combining
+    {
+        static_assert(FailurePercent <= 100, "FailurePercent is a percentage");
+        static constexpr bool enabled = true;
+        static constexpr uint32_t failure_percent = FailurePercent;
+    };
+
+    template <typename T, class Mixer=hash_mixer_none, class Backoff=backoff_none,
+             class Reclaim=solist_reclaim_hazard_pointers,
+             class Combine=solist_combining_none> class solist_accessor;
+
+    template <typename T, class Mixer=hash_mixer_none, class Backoff=backoff_none,
+             class Reclaim=solist_reclaim_hazard_pointers,
+             class Combine=solist_combining_none> struct solist:
+                 std::enable_shared_from_this<solist<T, Mixer, Backoff, Reclaim, Combine>>
     {
         uint32_t            n_buckets;
         uint32_t            max_bucket_length = 4;
         uint32_t            n_items = 0;
-        std::unique_ptr<solist_bucket*[]>     buckets = nullptr;
+        // The current bucket directory, indexed by slot.
+        solist_bucket**     buckets = nullptr;
+        const solist_growth growth = solist_growth::inline_growth;
+        // Random seed for hash mixing, per table so that hash collisions
+        // cannot be precomputed.
+        const hash_t        seed = std::random_device()();
+
+        // Every bucket directory allocated, the last entry is the current
+        // directory.
+        // Superseded directories are retained until destruction,
+        // because concurrent operations may still be indexing them.
+        std::vector<std::unique_ptr<solist_bucket*[]>> directories;
+        // Serialises expansion.
+        uint32_t            expanding = 0;
+        // Pending SOLIST_GROW_* requests, for deferred growth.
+        uint32_t            growth_requests = 0;
+        std::mutex          growth_mutex;
+        std::condition_variable growth_cv;
+        // State shared by the backoff policy instances of accessors.
+        typename Backoff::shared_state backoff_shared;
+        // State shared by the reclamation policy instances of accessors,
+        // for safe reclamation of deleted nodes.
+        // Accessors share ownership, so that accessors cached by local()
+        // can be destroyed after the solist.
+        std::shared_ptr<typename Reclaim::shared_state> reclaim_shared =
+            std::make_shared<typename Reclaim::shared_state>();
+        // Flat combining, null unless enabled by the Combine policy.
+        // Accessors share ownership of the publication records.
+        std::shared_ptr<solist_combiner<T>> combiner = Combine::enabled ?
+            std::make_shared<solist_combiner<T>>(Combine::failure_percent * 256 / 100) : nullptr;
 
         // Non copyable
         solist& operator=(const solist&) = delete;
@@ -126,18 +432,37 @@ namespace benedias {
         solist& operator=(solist&&) = delete;
         solist(solist&&) = delete;
 
-        //FIXME: create a hazard pointer domain on instantiation.
-        //FIXME: add API for creation/acquisition and destroy/release
-        //of hazard pointer blocks.
-        explicit solist(uint32_t size):n_buckets(size),buckets(new solist_bucket*[size])
+        explicit solist(uint32_t size):n_buckets(size)
         {
-            for(uint32_t x=0; x < n_buckets; ++x)
-            {
-                buckets[x] = nullptr;
-            }
+            buckets = new_directory(size);
+            buckets[0] = new solist_bucket(0);
+        }
+
+        /// \@param reclaimer - background reclaimer for deleted nodes,
+        /// may be shared by several solists, nullptr for reclamation
+        /// by the deleting threads.
+        /// \@param shared_domain - hazard pointer domain shared with other
+        /// containers, for example hazptr_domain::global(), nullptr for
+        /// a domain private to this solist.
+        /// reclaimer and shared_domain only apply to hazard pointer
+        /// reclamation, other policies ignore them.
+        explicit solist(uint32_t size, uint32_t bucket_length,
+                solist_growth growth_policy=solist_growth::inline_growth,
+                std::shared_ptr<hazptr_reclaimer> reclaimer=nullptr,
+                std::shared_ptr<hazptr_domain> shared_domain=nullptr):
+            n_buckets(size),max_bucket_length(bucket_length),growth(growth_policy),
+            reclaim_shared(std::make_shared<typename Reclaim::shared_state>(reclaimer, shared_domain))
+        {
+            buckets = new_directory(size);
             buckets[0] = new solist_bucket(0);
         }
 
+        /// Apply the hash mixer to a caller supplied hash value.
+        inline hash_t mix(hash_t hashv)
+        {
+            return Mixer::mix(hashv, seed);
+        }
+
         inline void inc_item_count()
         {
             __atomic_add_fetch(&n_items, 1, __ATOMIC_RELEASE); 
@@ -148,15 +473,6 @@ namespace benedias {
             __atomic_sub_fetch(&n_items, 1, __ATOMIC_RELEASE); 
         }
 
-        explicit solist(uint32_t size, uint32_t bucket_length):n_buckets(size),max_bucket_length(bucket_length),buckets(new solist_bucket*[size])
-        {
-            for(uint32_t x=0; x < n_buckets; ++x)
-            {
-                buckets[x] = nullptr;
-            }
-            buckets[0] = new solist_bucket(0);
-        }
-
         ~solist()
         {
             solist_bucket* cur = buckets[0];
@@ -170,34 +486,130 @@ namespace benedias {
             }
         }
 
-        //FIXME: expand is not thread safe!!! see comment at the end of the function.
+        /// Limit the memory held by deleted nodes awaiting reclamation,
+        /// past the budget deleting threads reclaim synchronously.
+        /// Set before the solist is in use.
+        /// \@param max_nodes - node count budget, 0 is unlimited.
+        /// \@param max_bytes - memory budget, 0 is unlimited.
+        void set_retired_budget(std::size_t max_nodes, std::size_t max_bytes)
+        {
+            reclaim_shared->set_retired_budget(max_nodes, max_bytes, sizeof(solist_node<T>));
+        }
+
+        /// True if deleted nodes awaiting reclamation exceed the budget,
+        /// producers may use this to throttle.
+        inline bool over_retired_budget() const
+        {
+            return reclaim_shared->over_retired_budget();
+        }
+
+        /// The accessor of the calling thread for this solist,
+        /// created on first use, so that short lived tasks do not reserve
+        /// hazard pointers or update reference counts on every call.
+        /// The accessor does not extend the lifetime of the solist,
+        /// the caller must keep the solist alive while using it.
+        /// Accessors are released when the thread exits, or when the
+        /// thread next calls local() on a solist of the same type after
+        /// this solist is destroyed.
+        /// The solist must be owned by a std::shared_ptr.
+        solist_accessor<T, Mixer, Backoff, Reclaim, Combine>& local();
+
+        /// Number of slots in the bucket directory.
+        /// The directory is published before the size, so a slot index
+        /// less than the value returned is always valid for bucket().
+        inline uint32_t size()
+        {
+            return __atomic_load_n(&n_buckets, __ATOMIC_ACQUIRE);
+        }
+
+        inline solist_bucket* bucket(uint32_t slot)
+        {
+            return __atomic_load_n(&buckets, __ATOMIC_ACQUIRE)[slot];
+        }
+
+        inline void set_bucket(uint32_t slot, solist_bucket* node)
+        {
+            __atomic_store_n(&__atomic_load_n(&buckets, __ATOMIC_ACQUIRE)[slot],
+                    node, __ATOMIC_RELEASE);
+        }
+
         void expand(uint32_t curr_size)
         {
-            if (curr_size < n_buckets)
+            if (curr_size < size() || curr_size >= SOLIST_MAX_BUCKETS)
             {
                 return;
             }
-            uint32_t new_size = n_buckets * 2;
-            auto new_buckets = std::make_unique<solist_bucket*[]>(new_size);
-            for (uint32_t x=0; x < n_buckets; ++x)
+
+            // Only one expansion at a time, a concurrent expansion
+            // will have doubled the size on our behalf.
+            uint32_t idle = 0;
+            if (!__atomic_compare_exchange_n(&expanding, &idle, 1,
+                        false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
             {
-                new_buckets[x] = buckets[x];
+                return;
             }
-            for (uint32_t x=n_buckets; x < new_size; ++x)
+
+            if (curr_size >= n_buckets)
             {
-                new_buckets[x] = nullptr;
+                solist_bucket** old_buckets = buckets;
+                uint32_t old_size = n_buckets;
+                solist_bucket** dir = new_directory(old_size * 2);
+                for (uint32_t x=0; x < old_size; ++x)
+                {
+                    dir[x] = __atomic_load_n(&old_buckets[x], __ATOMIC_ACQUIRE);
+                }
+                // Publish only once populated, concurrent operations
+                // must never see initialised buckets as null.
+                __atomic_store_n(&buckets, dir, __ATOMIC_RELEASE);
+                // Buckets initialised in the old directory after they
+                // were copied are not lost, initialise_bucket finds
+                // the dummy node already in the list, and sets the slot
+                // in the new directory.
+                __atomic_store_n(&n_buckets, old_size * 2, __ATOMIC_RELEASE);
             }
 
-            //FIXME:
-            // Intuitively swapping in the new buckets and n_buckets should
-            // be atomic w.r.t. other concurrent operations, so that matching
-            // buckets and n_buckets pair values are accessed.
-            //Solution 1: 
-            // add another level of indirection, so_list will be a wrapper around another
-            // class which has the buckets and n_buckets fields, extra level
-            // of indirection has performance impact.
-            buckets.swap(new_buckets);
-            n_buckets = new_size;
+            __atomic_store_n(&expanding, 0, __ATOMIC_RELEASE);
+        }
+
+        /// Signal growth pressure, used for deferred growth.
+        /// Wakes a maintainer if no requests were pending.
+        void request_growth(uint32_t request)
+        {
+            if (0 == __atomic_fetch_or(&growth_requests, request, __ATOMIC_ACQ_REL))
+            {
+                growth_cv.notify_one();
+            }
+        }
+
+        /// Claim all pending growth requests.
+        inline uint32_t take_growth_requests()
+        {
+            return __atomic_exchange_n(&growth_requests, 0, __ATOMIC_ACQ_REL);
+        }
+
+        /// Block until growth is requested or the timeout expires.
+        /// The timeout covers wake ups lost by request_growth, which
+        /// does not take the mutex.
+        template <class Rep, class Period>
+        void wait_for_growth_request(const std::chrono::duration<Rep, Period>& timeout)
+        {
+            std::unique_lock<std::mutex> lock(growth_mutex);
+            growth_cv.wait_for(lock, timeout,
+                    [this]{ return 0 != __atomic_load_n(&growth_requests, __ATOMIC_ACQUIRE);});
+        }
+
+        private:
+        // Allocate a new, empty, bucket directory,
+        // it is not published.
+        solist_bucket** new_directory(uint32_t size)
+        {
+            directories.emplace_back(new solist_bucket*[size]);
+            solist_bucket** dir = directories.back().get();
+            for(uint32_t x=0; x < size; ++x)
+            {
+                dir[x] = nullptr;
+            }
+            return dir;
         }
     };
 
@@ -211,14 +623,38 @@ namespace benedias {
     template <typename T> void check_solist(solist_accessor<T>& sol);
 #endif
 
-    template <typename T> class solist_accessor
+    template <typename T, class Mixer, class Backoff, class Reclaim, class Combine> class solist_accessor
     {
-        std::shared_ptr<solist<T>> so_list;
+        std::shared_ptr<solist<T, Mixer, Backoff, Reclaim, Combine>> so_list;
+        // Declared before reclaim, which references it.
+        std::shared_ptr<typename Reclaim::shared_state> reclaim_state;
+        // Reclamation policy instance, protecting next, cur and prev.
+        std::unique_ptr<Reclaim> reclaim;
+        // Shared with the solist, null unless combining is enabled.
+        std::shared_ptr<solist_combiner<T>> combiner;
+        // Publication record owned by this accessor, acquired when
+        // the accessor first combines.
+        solist_combine_request<T>* request = nullptr;
+
+        static constexpr std::size_t HP_NEXT = 0;
+        static constexpr std::size_t HP_CUR = 1;
+        static constexpr std::size_t HP_PREV = 2;
 
         solist_bucket *next;
         solist_bucket *cur;
         solist_bucket *prev;
         unsigned    steps;
+        // Applied after failed CAS operations.
+        Backoff     backoff;
+        // Failed CAS operations during the current insert or delete.
+        unsigned    cas_failures = 0;
+        // Moving average of the fraction of inserts and deletes
+        // with failed CAS operations, in 1/256ths.
+        uint32_t    cas_failure_rate = 0;
+        // Writes while combining, every COMBINE_SAMPLE_PERIODth write
+        // samples the lock free path to keep cas_failure_rate current.
+        uint32_t    combined_writes = 0;
+        static constexpr uint32_t COMBINE_SAMPLE_PERIOD = 16;
 
 #if 0
         friend void dump_solist_buckets(solist_accessor<T>& sol);
@@ -228,81 +664,177 @@ namespace benedias {
         friend void dump_solist_items(solist_accessor<T>& sol);
         friend void check_solist(solist_accessor<T>& sol);
 #else
-        template <typename U> friend void dump_solist_buckets(solist_accessor<U>& sol);
-        template <typename U> friend void dump_solist_keys(solist_accessor<U>& sol);
-        template <typename U> friend void dump_solist_key_order(solist_accessor<U>& sol);
-        template <typename U> friend void dump_solist(solist_accessor<U>& sol);
-        template <typename U> friend void dump_solist_items(solist_accessor<U>& sol);
-        template <typename U> friend void check_solist(solist_accessor<U>& sol);
+        template <typename U, class... P> friend void dump_solist_buckets(solist_accessor<U, P...>& sol);
+        template <typename U, class... P> friend void dump_solist_keys(solist_accessor<U, P...>& sol);
+        template <typename U, class... P> friend void dump_solist_key_order(solist_accessor<U, P...>& sol);
+        template <typename U, class... P> friend void dump_solist(solist_accessor<U, P...>& sol);
+        template <typename U, class... P> friend void dump_solist_items(solist_accessor<U, P...>& sol);
+        template <typename U, class... P> friend void check_solist(solist_accessor<U, P...>& sol);
 #endif       
 
+        // Load cur->next into next, and protect it.
+        // Fails if cur is marked for delete, the traversal must then be
+        // restarted.
+        inline bool load_next()
+        {
+            bool marked;
+            next = reclaim->protect(HP_NEXT, cur->next, &marked);
+            return !marked;
+        }
+
+        // Keep a node obtained by load_next protected under index.
+        // Bucket (dummy) nodes are never deleted while the solist exists,
+        // so they are not published.
+        inline void hold(std::size_t index, solist_bucket* node)
+        {
+            if (node->is_node())
+            {
+                reclaim->hold(index, node);
+            }
+        }
+
+        // Start a traversal at a bucket (dummy) node, unprotected.
+        inline bool start_at(solist_bucket* bucket)
+        {
+            prev = cur = bucket;
+            return load_next();
+        }
+
+        // Step forward one node.
+        // If next is marked for delete it is unlinked and retired instead,
+        // so that lookups do not walk over logically deleted nodes, and
+        // chains do not depend on a stalled deleter completing.
+        // Fails if the traversal must be restarted.
         inline bool advance()
         {
-            // TODO:  setup hazard pointers here in the required order
-            // and delete nodes traversed which marked for delete,
+            bool marked;
+            solist_bucket* after = next->next(&marked);
+            if (marked)
+            {
+                // Release, so that traversals loading after from cur
+                // see it initialised.
+                if (!cur->next.CAS(next, after, false, __ATOMIC_RELEASE))
+                {
+                    return false;
+                }
+                // Only the thread which unlinks a node, retires it.
+                reclaim->retire(next);
+                return load_next();
+            }
+            // Protection is rotated so that the nodes are
+            // protected throughout, the slots are written in the order
+            // HP_PREV, HP_CUR, HP_NEXT with release stores, so a node
+            // is always visible in a slot before its previous slot is
+            // overwritten.
             prev = cur;
+            hold(HP_PREV, prev);
             cur = next;
-            if (nullptr != cur)
-                next = cur->next();
-            return true;
+            hold(HP_CUR, cur);
+            return load_next();
+        }
+
+        inline void cas_failed()
+        {
+            ++cas_failures;
+            backoff.backoff();
+        }
+
+        inline void update_cas_failure_rate()
+        {
+            cas_failure_rate = cas_failure_rate - (cas_failure_rate / 16)
+                + (cas_failures ? 256 / 16 : 0);
+            cas_failures = 0;
         }
 
         inline void zap()
         {
-            //TODO: clear the hazard pointers.
             prev = cur = next = nullptr;
+            if (reclaim)
+            {
+                reclaim->end();
+            }
         }
 
-        void hazp_acquire()
+        void reclaim_acquire()
         {
-            // TODO: Acquire a block of 3 hazard pointers from
-            // the solist instance.
-            // The hazard pointers *must* be in the "domain"
+            // The policy instance *must* use the shared state
             // associated with the solist instance.
+            reclaim_state = so_list->reclaim_shared;
+            reclaim = std::make_unique<Reclaim>(*reclaim_state);
             zap();
         }
 
-        void hazp_release()
+        void reclaim_release()
         {
-            // TODO: Release the block of 3 hazard pointers back 
-            // to the solist, instance.
-            // The hazard pointers *must* be in the "domain"
-            // associated with the solist instance.
+            // Deleted nodes pending reclamation are handed over
+            // to the shared state.
+            reclaim.reset();
+            reclaim_state.reset();
+        }
+
+        void combine_acquire()
+        {
+            combiner = so_list->combiner;
+        }
+
+        void combine_release()
+        {
+            if (nullptr != request)
+            {
+                combiner->release_record(request);
+                request = nullptr;
+            }
+            combiner.reset();
         }
 
         public:
         solist_accessor& operator=(const solist_accessor& other)
         {
-            hazp_release();
+            reclaim_release();
+            combine_release();
             so_list = other.so_list;
-            hazp_acquire();
+            backoff = Backoff(so_list->backoff_shared);
+            reclaim_acquire();
+            combine_acquire();
+            return *this;
         }
 
-        solist_accessor(solist_accessor const& other)
+        solist_accessor(solist_accessor const& other):
+            so_list(other.so_list),backoff(so_list->backoff_shared)
         {
-            so_list = other.so_list;
-            hazp_acquire();
+            reclaim_acquire();
+            combine_acquire();
         }
 
-        solist_accessor(std::shared_ptr<solist<T>> sl):so_list(sl)
+        solist_accessor(std::shared_ptr<solist<T, Mixer, Backoff, Reclaim, Combine>> sl):
+            so_list(sl),backoff(so_list->backoff_shared)
         {
-            hazp_acquire();
+            reclaim_acquire();
+            combine_acquire();
         }
 
-        explicit solist_accessor(uint32_t size)
+        explicit solist_accessor(uint32_t size):
+            so_list(std::make_shared<solist<T, Mixer, Backoff, Reclaim, Combine>>(size)),
+            backoff(so_list->backoff_shared)
         {
-            so_list = std::make_shared<solist<T>>(size);
-            hazp_acquire();
+            reclaim_acquire();
+            combine_acquire();
         }
 
-        explicit solist_accessor(uint32_t size, uint32_t bucket_length)
+        explicit solist_accessor(uint32_t size, uint32_t bucket_length,
+                solist_growth growth=solist_growth::inline_growth):
+            so_list(std::make_shared<solist<T, Mixer, Backoff, Reclaim, Combine>>(size, bucket_length, growth)),
+            backoff(so_list->backoff_shared)
         {
-            so_list = std::make_shared<solist<T>>(size, bucket_length);
-            hazp_acquire();
+            reclaim_acquire();
+            combine_acquire();
         }
 
 
-        ~solist_accessor()=default;
+        ~solist_accessor()
+        {
+            combine_release();
+        }
 
         private:
         void get_parent(uint32_t slot, so_key key)
@@ -310,14 +842,14 @@ namespace benedias {
 get_parent_try_again:
             //find the initialised bucket with highest key value
             //that is lower than key.
-            so_key key_step = sol_bucket_key(so_list->n_buckets/2);
+            so_key key_step = sol_bucket_key(so_list->size()/2);
             so_key pb_key = key;
             uint32_t pb_slot;
             do
             {
                 pb_key -= key_step;
                 pb_slot = reverse_hasht_bits(pb_key);
-                if (so_list->buckets[pb_slot])
+                if (so_list->bucket(pb_slot))
                 {
                     break;
                 }
@@ -325,8 +857,10 @@ get_parent_try_again:
 
             // and then advance to the last data node in that bucket,
             // there may be none.
-            prev = cur = so_list->buckets[pb_slot];
-            next = cur->next();
+            if (!start_at(so_list->bucket(pb_slot)))
+            {
+                goto get_parent_try_again;
+            }
     
             while(nullptr != next && next->key < key)
             {
@@ -340,78 +874,113 @@ get_parent_try_again:
         public:
         void initialise_bucket(hash_t slot)
         {
-            assert(slot < so_list->n_buckets);
+            reclaim->begin();
+            init_bucket(slot);
+            zap();
+        }
+
+        private:
+        // Leaves the dummy node in next, and nodes protected.
+        void init_bucket(hash_t slot)
+        {
+            assert(slot < so_list->size());
 
-            if (so_list->buckets[slot] != nullptr)
+            if (so_list->bucket(slot) != nullptr)
             {
                 return;
             }
 
             auto node = new solist_bucket(slot);
             so_key key = node->key;
-            do
+            bool linked = false;
+            while(true)
             {
                 get_parent(slot, key);
                 // cur is the node after which to insert dummy node.
                 node->next = next;
-            }while (
+                if (
                     // a.n.other thread successfully has initialised
                     // the bucket.
-                    nullptr == so_list->buckets[slot]
+                    nullptr != so_list->bucket(slot)
                     // a.n.other thread successfully inserted its instance of
                     // the dummy node.
-                    && (nullptr == next || next->key != key)
-                    // this will fail if the relevant elements of the list
-                    // changed after calling get_parent
-                    && (!cur->next.CAS(next, node)));
-
-            if (so_list->buckets[slot] == nullptr)
-            {
-                if(cur->next() == node)
+                    || (nullptr != next && next->key == key))
                 {
-                    // success!
-                    so_list->buckets[slot] = node;
-                    next = node;
+                    break;
                 }
-                else
+                // this will fail if the relevant elements of the list
+                // changed after calling get_parent
+                if (cur->next.CAS_weak(next, node))
                 {
-                    // a.n.other thread inserted its instance of the bucket node.
-                    // Setup the slot correctly to point to that instance,
-                    // so the bucket is guaranteed 
-                    // to be initialised on return.
-                    so_list->buckets[slot] = next;
-                    assert(so_list->buckets[slot]->key == key);
-                    delete node;
+                    linked = true;
+                    break;
                 }
+                cas_failed();
+            }
+            backoff.reset();
+
+            if (linked)
+            {
+                // success!
+                // Only one instance of the dummy node can be linked, other
+                // threads can only set the slot to this instance.
+                so_list->set_bucket(slot, node);
+                next = node;
             }
             else
             {
-                // a.n.other thread has already initialised the bucket.
+                // a.n.other thread inserted its instance of the bucket node,
+                // ours was never visible.
+                // Setup the slot correctly to point to that instance,
+                // so the bucket is guaranteed 
+                // to be initialised on return.
+                if (so_list->bucket(slot) == nullptr)
+                {
+                    so_list->set_bucket(slot, next);
+                }
                 delete node;
             }
 
-            assert(nullptr != so_list->buckets[slot]);
-            assert(so_list->buckets[slot]->key == key);
+            assert(nullptr != so_list->bucket(slot));
+            assert(so_list->bucket(slot)->key == key);
         }
 
-        private:
-        bool find_node(hash_t hashv)
+        // \@param resume - continue from cur if it is still linked and
+        // precedes hashv, used by combiners sweeping requests in key order.
+        bool find_node(hash_t hashv, bool resume=false)
         {
-            uint32_t slot = hashv % so_list->n_buckets;
+            uint32_t slot = hashv % so_list->size();
             so_key key = sol_node_key(hashv);
 
-            if(so_list->buckets[slot] == nullptr)
+            if(so_list->bucket(slot) == nullptr)
             {
-                // lazy initialisation of a bucket
-                initialise_bucket(slot);
+                // lazy initialisation of a bucket moves the cursor
+                init_bucket(slot);
+                resume = false;
             }
-            
-find_node_try_again:
-            prev = cur = so_list->buckets[slot];
-            next = cur->next();
 
+            // cur is still protected, an unmarked
+            // node is in the list, so the traversal can continue from it.
+            if (resume && nullptr != cur && cur->precedes(key, hashv))
+            {
+                steps = 0;
+                prev = cur;
+                hold(HP_PREV, prev);
+                if (load_next())
+                {
+                    goto find_node_advance;
+                }
+            }
+
+find_node_try_again:
             steps = 0;
-            while((nullptr != next) && (next->key <= key))
+            if (!start_at(so_list->bucket(slot)))
+            {
+                goto find_node_try_again;
+            }
+
+find_node_advance:
+            while((nullptr != next) && next->precedes(key, hashv))
             {
                 if (!advance())
                 {
@@ -420,41 +989,129 @@ find_node_try_again:
                 ++steps;
             }
 
-            if((nullptr == cur) || (cur->key != key))
+            // The msb of the hash is not part of the key, so distinct
+            // hashes can share a key, the hash values must match as well.
+            if((nullptr == cur) || (cur->key != key) || (cur->hashv != hashv))
             {
                 return false;
             }
-            assert(cur->key == key);
             return true;
         }
 
-        public:
+        // Split the bucket of hashv, or double the number of buckets
+        // and split into the new half.
+        // With deferred growth the work is only requested.
+        // \@param nbuckets - number of buckets when the operation started.
+        void grow(hash_t hashv, uint32_t nbuckets, bool expand)
+        {
+            if (solist_growth::deferred_growth == so_list->growth)
+            {
+                so_list->request_growth(expand ? SOLIST_GROW_EXPAND : SOLIST_GROW_SPLIT);
+                return;
+            }
+
+            // Record the bucket number before expansion.
+            uint32_t slot = hashv % so_list->size();
+            if (expand)
+            {
+                so_list->expand(nbuckets);
+                // expand is skipped if another thread is expanding
+                // concurrently.
+                if (slot + nbuckets < so_list->size())
+                {
+                    init_bucket(slot + nbuckets);
+                }
+            }
+            else
+            {
+                // split the bucket we inserted into when a bucket
+                // "overflows", this is only effective if the bucket
+                // was not split following an expand.
+                uint32_t ib_slot = slot + (nbuckets/2);
+                // Check that the bucket exists before attempting to 
+                // initialise it.
+                // This is a result of delaying expensive expansion.
+                if (ib_slot < so_list->size())
+                {
+                    init_bucket(ib_slot);
+                }
+            }
+        }
+
+        // Called after a lookup, lookups walking chains well past
+        // max_bucket_length split the bucket, so read mostly
+        // tables with chains which grew under an old n_buckets,
+        // recover without inserts.
+        // The directory is only expanded if the buckets are full on
+        // average, a long chain in a sparse table is made of colliding
+        // hash values, which expanding would not separate.
+        // Then the bucket of hashv in the current directory is
+        // initialised, if it is not, it is a child of the bucket walked.
+        // With deferred growth the work is only requested.
+        // \@return true if prev, cur and next were changed.
+        bool grow_after_lookup(hash_t hashv)
+        {
+            if (steps <= so_list->max_bucket_length * 2)
+            {
+                return false;
+            }
+            bool expand = so_list->n_items > (so_list->max_bucket_length * so_list->size());
+            if (solist_growth::deferred_growth == so_list->growth)
+            {
+                if (expand)
+                {
+                    so_list->request_growth(SOLIST_GROW_EXPAND);
+                }
+                else if (nullptr == so_list->bucket(hashv % so_list->size()))
+                {
+                    so_list->request_growth(SOLIST_GROW_SPLIT);
+                }
+                return false;
+            }
+
+            if (expand)
+            {
+                so_list->expand(so_list->size());
+            }
+            uint32_t slot = hashv % so_list->size();
+            if (nullptr == so_list->bucket(slot))
+            {
+                init_bucket(slot);
+                return true;
+            }
+            return false;
+        }
+
+        private:
         // insert is the most expensive operation because
         // it is the best location to amortise some of the 
         // cost of automatic expanding the number of buckets.
         // FIXME: explore using bucket item counters.
         // complexity getting the counts correct on bucket split.
-        bool insert_node(hash_t hashv, T payload)
+        // hashv is mixed, nodes are left protected.
+        bool insert_impl(hash_t hashv, const T& payload, bool resume=false)
         {
             bool result = false;
-            uint32_t    nbuckets = so_list->n_buckets;
+            uint32_t    nbuckets = so_list->size();
             auto dnode = new solist_node<T>(payload, hashv);
 
             while(true)
             {
-                if(find_node(hashv))
+                if(find_node(hashv, resume))
                 {
                     break;
                 }
                 
                 dnode->next = next;
-                if(cur->next.CAS(next, dnode))
+                if(cur->next.CAS_weak(next, dnode))
                 {
                     so_list->inc_item_count();
                     result = true;
                     break;
                 }
+                cas_failed();
             }
+            backoff.reset();
 
             if (!result)
             {
@@ -462,19 +1119,16 @@ find_node_try_again:
             }
             else
             {
-                // !!!WARNING!!!  if we need to initialise a hazard pointer to the
-                // newly added node then we should set that before proceeding with
-                // the expansion check.
-
-                next = cur->next();
-
                 // added a node, so do expansion check.
+                if (!load_next())
+                {
+                    return result;
+                }
                 while(nullptr != next && next->is_node())
                 {
                     if (!advance())
                     {
                         // FIXME: for now chicken out and just return
-                        zap();
                         return result;
                     }
                     ++steps;
@@ -482,86 +1136,352 @@ find_node_try_again:
 
                 if(steps > so_list->max_bucket_length)
                 {
-                    // Record the bucket number before expansion.
-                    uint32_t slot = hashv % so_list->n_buckets;
                     // expand if
                     // 1) the bucket is overflows by a factor of 2 FIXME (make the factor configurable) 
                     //      this can happen for pathological insert sequences where
                     //      inserts are to the same bucket repeatedly.
                     // 2) all the buckets are full
-                    if (
+                    grow(hashv, nbuckets,
                             (steps >= ((so_list->max_bucket_length * 2)))
                             ||
-                            (so_list->n_items >= (so_list->max_bucket_length * so_list->n_buckets))
-                       )
-                    {
-                        so_list->expand(nbuckets);
-                        initialise_bucket(slot + nbuckets);
-                    }
-                    else
-                    {
-                        // split the bucket we inserted into when a bucket
-                        // "overflows", this is only effective if the bucket
-                        // was not split following an expand.
-                        uint32_t ib_slot = slot + (nbuckets/2);
-                        // Check that the bucket exists before attempting to 
-                        // initialise it.
-                        // This is a result of delaying expensive expansion.
-                        if (ib_slot < so_list->n_buckets)
-                        {
-                            initialise_bucket(ib_slot);
-                        }
-                    }
+                            (so_list->n_items >= (so_list->max_bucket_length * so_list->size()))
+                        );
                 }
             }
-            zap();
             return result;
         }
 
-        bool delete_node(hash_t hashv)
+        // hashv is mixed, nodes are left protected.
+        bool delete_impl(hash_t hashv, bool resume=false)
         {
             bool result = false;
 
             while(true)
             {
-                if(!find_node(hashv))
+                if(!find_node(hashv, resume))
                 {
                     break;
                 }
                 
                 // Mark
-                if(!cur->next.CAS(next, next, true))
+                if(!cur->next.CAS_weak(next, next, true))
                 {
+                    cas_failed();
                     continue;
                 }
 
+                // The node is now logically deleted.
+                so_list->dec_item_count();
+                result = true;
+
                 // remove
-                if(prev->next.CAS(cur, next))
+                if(prev->next.CAS(cur, next, false, __ATOMIC_RELEASE))
+                {
+                    reclaim->retire(cur);
+                }
+                else
                 {
-                   so_list->dec_item_count();
-                   delete cur; 
-                   result = true;
-                   break;
+                    // The list changed, traversing to the node will
+                    // unlink and retire it.
+                    find_node(hashv);
                 }
+                break;
             }
+            backoff.reset();
+            return result;
+        }
+
+        // Combine while the CAS failure rate is above the threshold,
+        // except for periodic samples of the lock free path.
+        inline bool use_combining()
+        {
+            return Combine::enabled
+                && cas_failure_rate >= combiner->threshold
+                && 0 != (++combined_writes % COMBINE_SAMPLE_PERIOD);
+        }
+
+        // Apply every pending request for the combiner lock held,
+        // in split order key order, so that each request continues the
+        // traversal from the position of the previous one.
+        void combine_requests(uint32_t lock_index)
+        {
+            solist_combine_request<T>* batch[solist_combiner<T>::N_BATCH];
+            unsigned n_batch = 0;
+
+            reclaim->begin();
+
+            for (auto req = __atomic_load_n(&combiner->records, __ATOMIC_ACQUIRE);
+                    nullptr != req && n_batch < solist_combiner<T>::N_BATCH;
+                    req = req->next_record)
+            {
+                // The owner may republish the record between the loads,
+                // the exchange only succeeds for a complete request.
+                uint32_t state = SOLIST_REQ_PENDING;
+                if (SOLIST_REQ_PENDING == __atomic_load_n(&req->state, __ATOMIC_ACQUIRE)
+                        && lock_index == __atomic_load_n(&req->lock_index, __ATOMIC_RELAXED)
+                        && __atomic_compare_exchange_n(&req->state, &state,
+                            SOLIST_REQ_COMBINING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                {
+                    batch[n_batch++] = req;
+                }
+            }
+
+            std::sort(batch, batch + n_batch,
+                    [](solist_combine_request<T>* a, solist_combine_request<T>* b)
+                    { return sol_node_key(a->hashv) < sol_node_key(b->hashv)
+                        || (sol_node_key(a->hashv) == sol_node_key(b->hashv) && a->hashv < b->hashv);});
 
+            bool resume = false;
+            for (unsigned x = 0; x < n_batch; ++x)
+            {
+                solist_combine_request<T>* req = batch[x];
+                req->result = req->insert ?
+                    insert_impl(req->hashv, *req->payload_ptr(), resume) :
+                    delete_impl(req->hashv, resume);
+                resume = true;
+                __atomic_store_n(&req->state, SOLIST_REQ_DONE, __ATOMIC_RELEASE);
+            }
             zap();
+            // Contention met on behalf of other threads is not sampled.
+            cas_failures = 0;
+        }
+
+        // Publish an insert or delete in the record of this accessor and
+        // wait for a combiner to apply it, becoming the combiner if the
+        // lock for the bucket is free.
+        bool combine(bool insert, hash_t hashv, const T* payload)
+        {
+            if (nullptr == request)
+            {
+                request = combiner->acquire_record();
+            }
+            solist_combine_request<T>* req = request;
+
+            req->insert = insert;
+            req->hashv = hashv;
+            __atomic_store_n(&req->lock_index,
+                    (hashv % so_list->size()) % solist_combiner<T>::N_LOCKS, __ATOMIC_RELAXED);
+            if (insert)
+            {
+                new (req->payload) T(*payload);
+            }
+            __atomic_store_n(&req->state, SOLIST_REQ_PENDING, __ATOMIC_RELEASE);
+
+            unsigned spins = 0;
+            while (SOLIST_REQ_DONE != __atomic_load_n(&req->state, __ATOMIC_ACQUIRE))
+            {
+                if (combiner->try_lock(req->lock_index))
+                {
+                    combine_requests(req->lock_index);
+                    combiner->unlock(req->lock_index);
+                }
+                else if (++spins < 64)
+                {
+                    cpu_relax();
+                }
+                else
+                {
+                    // The combiner may have been preempted.
+                    std::this_thread::yield();
+                }
+            }
+
+            bool result = req->result;
+            if (insert)
+            {
+                req->payload_ptr()->~T();
+            }
+            __atomic_store_n(&req->state, SOLIST_REQ_FREE, __ATOMIC_RELEASE);
+            return result;
+        }
+
+        public:
+        bool insert_node(hash_t hashv, T payload)
+        {
+            hashv = so_list->mix(hashv);
+            if (use_combining())
+            {
+                return combine(true, hashv, &payload);
+            }
+
+            reclaim->begin();
+            bool result = insert_impl(hashv, payload);
+            zap();
+            update_cas_failure_rate();
+            return result;
+        }
+
+        bool delete_node(hash_t hashv)
+        {
+            hashv = so_list->mix(hashv);
+            if (use_combining())
+            {
+                return combine(false, hashv, nullptr);
+            }
+
+            reclaim->begin();
+            bool result = delete_impl(hashv);
+            zap();
+            update_cas_failure_rate();
             return result;
         }
 
+        /// Perform pending deferred growth requests,
+        /// expand the bucket directory if requested and then initialise
+        /// every uninitialised bucket, ahead of demand.
+        /// Safe to call concurrently, from maintainer threads or from
+        /// application threads when idle.
+        /// \@return true if there was work to do.
+        bool maintain()
+        {
+            uint32_t requests = so_list->take_growth_requests();
+            if (0 == requests)
+            {
+                // A quiescent state, for policies which need them.
+                zap();
+                return false;
+            }
+
+            reclaim->begin();
+            if (requests & SOLIST_GROW_EXPAND)
+            {
+                so_list->expand(so_list->size());
+            }
+            // Requests are coalesced, so keep expanding until all
+            // the buckets are no longer full.
+            while (so_list->size() < SOLIST_MAX_BUCKETS
+                    && so_list->n_items > (so_list->max_bucket_length * so_list->size()))
+            {
+                so_list->expand(so_list->size());
+            }
+
+            uint32_t nbuckets = so_list->size();
+            for (uint32_t slot = 1; slot < nbuckets; ++slot)
+            {
+                if (nullptr == so_list->bucket(slot))
+                {
+                    init_bucket(slot);
+                }
+            }
+            zap();
+            return true;
+        }
+
         // FIXME: for proper operation we should return type hazard_pointer<T>
         // TBD.
+        /// The item returned is protected until release() is called, or
+        /// until the next operation using this accessor.
+        /// While an item is protected, epoch based policies keep the
+        /// thread in its epoch, so no deleted node can be reclaimed,
+        /// call release() once the item is no longer used.
+        /// Nothing is protected if the item is not found.
         T* find_item_node(hash_t hashv)
         {
-            if (find_node(hashv))
+            hashv = so_list->mix(hashv);
+            reclaim->begin();
+            T* item = nullptr;
+            bool found = find_node(hashv);
+            if (grow_after_lookup(hashv))
+            {
+                // Growing reuses the protection slots, so look up again to
+                // protect the item.
+                found = find_node(hashv);
+            }
+            if (found)
             {
                 // can make cheaper using reinterpret_cast for now this is safer,
                 // but more expensive.
                 solist_node<T>* node = dynamic_cast<solist_node<T>*>(cur);
-                return node->get_item_ptr();
+                item = node->get_item_ptr();
+            }
+            else
+            {
+                zap();
+            }
+            return item;
+        }
+
+        /// End protection of the item returned by find_item_node.
+        void release()
+        {
+            zap();
+        }
+    };
+
+    template <typename T, class Mixer, class Backoff, class Reclaim, class Combine>
+        solist_accessor<T, Mixer, Backoff, Reclaim, Combine>& solist<T, Mixer, Backoff, Reclaim, Combine>::local()
+    {
+        struct cache_entry
+        {
+            std::weak_ptr<solist> owner;
+            solist* list;
+            std::unique_ptr<solist_accessor<T, Mixer, Backoff, Reclaim, Combine>> accessor;
+        };
+        // Per thread, per solist type.
+        static thread_local std::vector<cache_entry> cache;
+
+        // Accessors of destroyed solists only reference the reclamation
+        // state, which they share ownership of, so are safe to destroy.
+        // Once these are removed, no other entry can have the same address.
+        cache.erase(std::remove_if(cache.begin(), cache.end(),
+                    [](const cache_entry& entry){ return entry.owner.expired();}),
+                cache.end());
+        for (auto& entry: cache)
+        {
+            if (this == entry.list)
+            {
+                return *entry.accessor;
+            }
+        }
+
+        assert(!this->weak_from_this().expired());
+        // Aliasing an empty shared_ptr, the accessor does not own the solist.
+        std::shared_ptr<solist> unowned(std::shared_ptr<solist>(), this);
+        cache.push_back(cache_entry{this->weak_from_this(), this,
+                std::make_unique<solist_accessor<T, Mixer, Backoff, Reclaim, Combine>>(unowned)});
+        return *cache.back().accessor;
+    }
+
+    /// Background thread performing deferred growth for a solist.
+    /// Only useful if the solist was created with solist_growth::deferred_growth.
+    /// The lifetime of the solist is extended to the lifetime of the maintainer.
+    template <typename T, class Mixer=hash_mixer_none, class Backoff=backoff_none,
+             class Reclaim=solist_reclaim_hazard_pointers,
+             class Combine=solist_combining_none> class solist_maintainer
+    {
+        std::shared_ptr<solist<T, Mixer, Backoff, Reclaim, Combine>> so_list;
+        bool        stop = false;
+        std::thread worker;
+
+        void run()
+        {
+            solist_accessor<T, Mixer, Backoff, Reclaim, Combine> sa(so_list);
+            while(!__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+            {
+                so_list->wait_for_growth_request(std::chrono::milliseconds(10));
+                sa.maintain();
             }
+        }
+
+        public:
+        // Non copyable
+        solist_maintainer& operator=(const solist_maintainer&) = delete;
+        solist_maintainer(solist_maintainer const&) = delete;
 
-            return nullptr;
+        // Non movable
+        solist_maintainer& operator=(solist_maintainer&&) = delete;
+        solist_maintainer(solist_maintainer&&) = delete;
+
+        explicit solist_maintainer(std::shared_ptr<solist<T, Mixer, Backoff, Reclaim, Combine>> sl):so_list(sl)
+        {
+            worker = std::thread(&solist_maintainer<T, Mixer, Backoff, Reclaim, Combine>::run, this);
+        }
+
+        ~solist_maintainer()
+        {
+            __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+            so_list->growth_cv.notify_all();
+            worker.join();
         }
     };
 
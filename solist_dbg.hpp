@@ -19,15 +19,16 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef BENEDIAS_SOLIST_DBG_HPP
 #define BENEDIAS_SOLIST_DBG_HPP
 #include "solist.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <iostream>
 #include <memory>
 namespace benedias {
     namespace concurrent {
 
-    template <typename T> void dump_solist_buckets(solist_accessor<T>& sa)
+    template <typename T, class... P> void dump_solist_buckets(solist_accessor<T, P...>& sa)
     {
-        std::shared_ptr<solist<T>> sol = sa.so_list;
+        auto sol = sa.so_list;
 
         fprintf(stderr,
                 "(=== dump_solist_buckets %p\n", &sol);
@@ -49,10 +50,10 @@ namespace benedias {
         std::cerr << std::endl << "===)" << std::endl;
     }
 
-    template <typename T> void dump_solist_keys(solist_accessor<T>& sa)
+    template <typename T, class... P> void dump_solist_keys(solist_accessor<T, P...>& sa)
     {
         sa.zap();
-        std::shared_ptr<solist<T>> sol = sa.so_list;
+        auto sol = sa.so_list;
 
         solist_bucket *cur = sol->buckets[0];
         fprintf(stderr,
@@ -73,9 +74,9 @@ namespace benedias {
         std::cerr << std::endl << "===)" << std::endl;
     }
 
-    template <typename T> void dump_solist_key_order(solist_accessor<T>& sa)
+    template <typename T, class... P> void dump_solist_key_order(solist_accessor<T, P...>& sa)
     {
-        std::shared_ptr<solist<T>> sol = sa.so_list;
+        auto sol = sa.so_list;
 
         solist_bucket *cur = sol->buckets[0];
         fprintf(stderr,
@@ -89,9 +90,9 @@ namespace benedias {
         std::cerr << std::endl << "===)" << std::endl;
     }
 
-    template <typename T> void dump_solist(solist_accessor<T>& sa)
+    template <typename T, class... P> void dump_solist(solist_accessor<T, P...>& sa)
     {
-        std::shared_ptr<solist<T>> sol = sa.so_list;
+        auto sol = sa.so_list;
 
         solist_bucket *cur = sol->buckets[0];
         fprintf(stderr,
@@ -132,9 +133,9 @@ namespace benedias {
         std::cerr << "===)" << std::endl;
     }
 
-    template <typename T> void dump_solist_items(solist_accessor<T>& sa)
+    template <typename T, class... P> void dump_solist_items(solist_accessor<T, P...>& sa)
     {
-        std::shared_ptr<solist<T>> sol = sa.so_list;
+        auto sol = sa.so_list;
 
         solist_bucket *cur = sol->buckets[0];
         fprintf(stderr,
@@ -152,9 +153,22 @@ namespace benedias {
     }
 
 
-    template <typename T> void check_solist(solist_accessor<T>& sa)
+    // Longest run of data nodes between initialised buckets.
+    template <typename T, class... P> uint32_t longest_chain(solist<T, P...>& sl)
     {
-        std::shared_ptr<solist<T>> sol = sa.so_list;
+        uint32_t longest = 0;
+        uint32_t len = 0;
+        for(auto cur = sl.buckets[0]; nullptr != cur; cur = cur->next())
+        {
+            len = cur->is_node() ? len + 1 : 0;
+            longest = std::max(longest, len);
+        }
+        return longest;
+    }
+
+    template <typename T, class... P> void check_solist(solist_accessor<T, P...>& sa)
+    {
+        auto sol = sa.so_list;
 
         fprintf(stderr,
                 "(=== check_solist %p ", &sol);
@@ -162,14 +176,17 @@ namespace benedias {
                 "checking for monotonically increasing keys ");
         solist_bucket *cur = sol->buckets[0];
         hash_t  key = cur->key;
+        hash_t  hashv = cur->hashv;
         cur = cur->next();
         while(cur)
         {
-            if (!(cur->key > key))
+            // hash values differing only in the msb have the same key.
+            if (!(cur->key > key || (cur->key == key && cur->hashv > hashv)))
             {
                 fprintf(stderr, "\nFail:: %p 0x%08x %p; prev=0x%08x", cur, cur->key, cur->next(), key);
             }
             key = cur->key;
+            hashv = cur->hashv;
             cur = cur->next();
         }
         std::cerr << "===)" << std::endl;
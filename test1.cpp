@@ -28,6 +28,7 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 using   benedias::concurrent::solist;
 using   benedias::concurrent::solist_accessor;
 using   benedias::concurrent::hash_t;
+using   benedias::concurrent::hash_mixer_fmix32;
 
 void test0_1(hash_t h[3])
 {
@@ -178,6 +179,92 @@ void test3()
     benedias::concurrent::check_solist(sol);
 }
 
+// test hash mixing, hash values differ only in the high bits, so without
+// mixing all items land in the same bucket.
+// Without mixing every insert past twice the maximum bucket length doubles
+// the number of buckets, so fewer items are inserted into that solist.
+void test4()
+{
+    constexpr uint32_t count = 256;
+    constexpr uint32_t raw_count = 16;
+    auto raw = std::make_shared<solist<uint32_t>>(2, 4);
+    auto mixed = std::make_shared<solist<uint32_t, hash_mixer_fmix32>>(2, 4);
+    solist_accessor<uint32_t> sol_raw(raw);
+    solist_accessor<uint32_t, hash_mixer_fmix32> sol_mixed(mixed);
+
+    for(uint32_t x = 0; x < raw_count; ++x)
+    {
+        sol_raw.insert_node(x << 20, x);
+    }
+    for(uint32_t x = 0; x < count; ++x)
+    {
+        sol_mixed.insert_node(x << 20, x);
+    }
+    for(uint32_t x = 0; x < count; ++x)
+    {
+        if (nullptr == sol_mixed.find_item_node(x << 20))
+        {
+            std::cout << "Failed! could not find item with hash " << (x << 20) << std::endl;
+        }
+    }
+    if (!sol_mixed.delete_node(5 << 20) || nullptr != sol_mixed.find_item_node(5 << 20))
+    {
+        std::cout << "Failed! delete of item with hash " << (5 << 20) << std::endl;
+    }
+    benedias::concurrent::check_solist(sol_mixed);
+
+    std::cout << "longest chain without mixing " << benedias::concurrent::longest_chain(*raw)
+        << ", with mixing " << benedias::concurrent::longest_chain(*mixed) << std::endl;
+    if (benedias::concurrent::longest_chain(*mixed) >= benedias::concurrent::longest_chain(*raw))
+    {
+        std::cout << "Failed! mixing did not shorten the longest chain" << std::endl;
+    }
+}
+
+// test hash values which differ only in the msb, they have the same
+// split ordered key, but are distinct items.
+void test5()
+{
+    constexpr hash_t msb = 0x80000000;
+    hash_t h[] = {5, 5 | msb, 7, 7 | msb, 13 | msb};
+    auto sl = std::make_shared<solist<uint32_t>>(2, 4);
+    solist_accessor<uint32_t> sol(sl);
+
+    // insert in both orders of each colliding pair.
+    for(auto x : {1, 0, 2, 3, 4})
+    {
+        if (!sol.insert_node(h[x], x))
+        {
+            std::cout << "Failed! insert of item with hash " << std::hex << h[x] << std::dec << std::endl;
+        }
+    }
+    if (sol.insert_node(h[1], 1))
+    {
+        std::cout << "Failed! duplicate insert of item with hash " << std::hex << h[1] << std::dec << std::endl;
+    }
+    for(uint32_t x = 0; x < 5; ++x)
+    {
+        uint32_t* item = sol.find_item_node(h[x]);
+        if (nullptr == item || *item != x)
+        {
+            std::cout << "Failed! find of item with hash " << std::hex << h[x] << std::dec << std::endl;
+        }
+    }
+    if (nullptr != sol.find_item_node(13))
+    {
+        std::cout << "Failed! found item with hash " << 13 << std::endl;
+    }
+    if (!sol.delete_node(h[0]) || nullptr != sol.find_item_node(h[0]))
+    {
+        std::cout << "Failed! delete of item with hash " << std::hex << h[0] << std::dec << std::endl;
+    }
+    uint32_t* item = sol.find_item_node(h[1]);
+    if (nullptr == item || *item != 1)
+    {
+        std::cout << "Failed! find after delete of item with hash " << std::hex << h[1] << std::dec << std::endl;
+    }
+    benedias::concurrent::check_solist(sol);
+}
 
 // experimental function
 void testx()
@@ -222,6 +309,10 @@ int main( int argc, char* argv[] )
                 tf = test2; break;
             case '3':
                 tf = test3; break;
+            case '4':
+                tf = test4; break;
+            case '5':
+                tf = test5; break;
             case 'x':
                 tf = testx; break;
         }
@@ -0,0 +1,251 @@
+/*
+
+Copyright (C) 2019  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Multi threaded insert, delete and lookup churn on a small set of keys,
+so that deleters, inserters and lookups contend on the same nodes.
+Runs with and without flat combining of inserts and deletes,
+with a background reclaimer, and with the process wide hazard
+pointer domain.
+Run under the address sanitizer, this checks that nodes unlinked
+by deleters or by traversals are not freed while in use.
+*/
+#include "solist.hpp"
+#include "solist_dbg.hpp"
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using   benedias::concurrent::solist;
+using   benedias::concurrent::solist_accessor;
+using   benedias::concurrent::hash_t;
+using   benedias::concurrent::hash_mixer_none;
+using   benedias::concurrent::backoff_none;
+using   benedias::concurrent::backoff_proportional;
+using   benedias::concurrent::hazptr_reclaimer;
+using   benedias::concurrent::hazptr_domain;
+using   benedias::concurrent::solist_reclaim_hazard_pointers;
+using   benedias::concurrent::solist_reclaim_epoch;
+using   benedias::concurrent::solist_reclaim_qsbr;
+using   benedias::concurrent::solist_combining_none;
+using   benedias::concurrent::solist_combining;
+
+constexpr   unsigned num_threads = 8;
+constexpr   unsigned num_keys = 64;
+constexpr   unsigned num_iterations = 20000;
+
+struct churn_counts
+{
+    unsigned inserted = 0;
+    unsigned deleted = 0;
+    unsigned found = 0;
+};
+
+template <class Backoff, class Reclaim, class Combine> void churn_thread_fn(
+        std::shared_ptr<solist<uint32_t, hash_mixer_none, Backoff, Reclaim, Combine>> sl,
+        unsigned seed, churn_counts& counts)
+{
+    solist_accessor<uint32_t, hash_mixer_none, Backoff, Reclaim, Combine> sol(sl);
+    for (unsigned x = 0; x < num_iterations; ++x)
+    {
+        seed = seed * 1103515245 + 12345;
+        hash_t key = (seed >> 8) % num_keys;
+        switch((seed >> 4) % 3)
+        {
+            case 0:
+                if (sol.insert_node(key, key))
+                    ++counts.inserted;
+                break;
+            case 1:
+                if (sol.delete_node(key))
+                    ++counts.deleted;
+                break;
+            default:
+                {
+                    uint32_t* item = sol.find_item_node(key);
+                    if (nullptr != item)
+                    {
+                        if (*item != key)
+                        {
+                            std::cout << "Failed! found " << *item << " for key " << key << std::endl;
+                        }
+                        ++counts.found;
+                    }
+                    sol.release();
+                }
+                break;
+        }
+    }
+}
+
+// Combine - flat combining policy, solist_combining<0> makes every
+// accessor combine.
+// \@param reclaimer - background reclaimer for deleted nodes, or nullptr.
+// \@param shared_domain - shared hazard pointer domain, or nullptr.
+template <class Backoff, class Reclaim=solist_reclaim_hazard_pointers,
+         class Combine=solist_combining_none> void test_churn(
+        std::shared_ptr<hazptr_reclaimer> reclaimer=nullptr,
+        std::shared_ptr<hazptr_domain> shared_domain=nullptr)
+{
+    auto sl = std::make_shared<solist<uint32_t, hash_mixer_none, Backoff, Reclaim, Combine>>(2, 4,
+            benedias::concurrent::solist_growth::inline_growth, reclaimer, shared_domain);
+    std::vector<std::thread> threads;
+    std::vector<churn_counts> counts(num_threads);
+
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        threads.emplace_back(churn_thread_fn<Backoff, Reclaim, Combine>, sl, std::rand(), std::ref(counts[i]));
+    }
+    for (auto& th: threads)
+    {
+        th.join();
+    }
+
+    solist_accessor<uint32_t, hash_mixer_none, Backoff, Reclaim, Combine> sol(sl);
+    unsigned present = 0;
+    for (hash_t key = 0; key < num_keys; ++key)
+    {
+        if (nullptr != sol.find_item_node(key))
+            ++present;
+    }
+    sol.release();
+    unsigned inserted = 0, deleted = 0, found = 0;
+    for (auto& c: counts)
+    {
+        inserted += c.inserted;
+        deleted += c.deleted;
+        found += c.found;
+    }
+    std::cout << "inserted " << inserted << " deleted " << deleted << " found " << found
+        << " present " << present << " n_items " << sl->n_items << std::endl;
+    if (inserted - deleted != present || present != sl->n_items)
+    {
+        std::cout << "Failed! inserted - deleted != present" << std::endl;
+    }
+    benedias::concurrent::check_solist(sol);
+}
+
+// Short lived tasks using the cached per thread accessors.
+template <class Reclaim> void local_thread_fn(
+        std::shared_ptr<solist<uint32_t, hash_mixer_none, backoff_none, Reclaim>> sl,
+        unsigned seed)
+{
+    for (unsigned x = 0; x < num_iterations; ++x)
+    {
+        auto& sol = sl->local();
+        if (&sol != &sl->local())
+        {
+            std::cout << "Failed! local() returned a different accessor" << std::endl;
+        }
+        seed = seed * 1103515245 + 12345;
+        hash_t key = (seed >> 8) % num_keys;
+        if (!sol.insert_node(key, key))
+        {
+            sol.delete_node(key);
+        }
+    }
+}
+
+template <class Reclaim> void test_local()
+{
+    using list_type = solist<uint32_t, hash_mixer_none, backoff_none, Reclaim>;
+    auto sl = std::make_shared<list_type>(2, 4);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        threads.emplace_back(local_thread_fn<Reclaim>, sl, std::rand());
+    }
+    for (auto& th: threads)
+    {
+        th.join();
+    }
+    sl->local().insert_node(num_keys, num_keys);
+    benedias::concurrent::check_solist(sl->local());
+
+    // The accessor cached for a destroyed solist is released
+    // by the next call to local().
+    sl.reset();
+    sl = std::make_shared<list_type>(2, 4);
+    if (nullptr != sl->local().find_item_node(num_keys))
+    {
+        std::cout << "Failed! stale accessor returned by local()" << std::endl;
+    }
+    std::cout << "local accessors n_items " << sl->n_items << std::endl;
+}
+
+// An item found and released must not keep the thread in its epoch,
+// otherwise nodes deleted by other threads are never reclaimed.
+template <class Reclaim> void test_release()
+{
+    constexpr unsigned n_deletes = 8 * benedias::concurrent::SOLIST_RETIRE_BATCH;
+    auto sl = std::make_shared<solist<uint32_t, hash_mixer_none, backoff_none, Reclaim>>(2, 4);
+    solist_accessor<uint32_t, hash_mixer_none, backoff_none, Reclaim> reader(sl);
+    solist_accessor<uint32_t, hash_mixer_none, backoff_none, Reclaim> writer(sl);
+
+    reader.insert_node(num_keys, num_keys);
+    if (nullptr == reader.find_item_node(num_keys))
+    {
+        std::cout << "Failed! could not find item with hash " << num_keys << std::endl;
+    }
+    reader.release();
+
+    for (unsigned x = 0; x < n_deletes; ++x)
+    {
+        writer.insert_node(x % num_keys, x);
+        writer.delete_node(x % num_keys);
+    }
+    std::size_t retired = __atomic_load_n(&sl->reclaim_shared->retired, __ATOMIC_RELAXED);
+    std::cout << "released reader, retired " << retired << " of " << n_deletes << std::endl;
+    if (retired >= n_deletes / 2)
+    {
+        std::cout << "Failed! a released reader blocked reclamation" << std::endl;
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    std::setlocale(LC_ALL, "en_US.UTF-8");
+    std::srand(std::time(nullptr)); // use current time as seed for random generator
+    test_churn<backoff_none>();
+    test_churn<backoff_proportional<>>();
+    test_churn<backoff_none, solist_reclaim_hazard_pointers, solist_combining<0>>();
+    test_churn<backoff_none, solist_reclaim_hazard_pointers, solist_combining<5>>();
+    {
+        // One reclaimer shared by two lists.
+        auto reclaimer = hazptr_reclaimer::make(std::chrono::milliseconds(1));
+        test_churn<backoff_none>(reclaimer);
+        test_churn<backoff_proportional<>>(reclaimer);
+        // Lists of different types sharing the process wide domain.
+        test_churn<backoff_none>(nullptr, hazptr_domain::global());
+        test_churn<backoff_proportional<>>(reclaimer, hazptr_domain::global());
+    }
+    // Epoch based and quiescent state based reclamation.
+    test_churn<backoff_none, solist_reclaim_epoch>();
+    test_churn<backoff_none, solist_reclaim_epoch, solist_combining<5>>();
+    test_churn<backoff_none, solist_reclaim_qsbr>();
+    test_churn<backoff_none, solist_reclaim_qsbr, solist_combining<5>>();
+    test_local<solist_reclaim_hazard_pointers>();
+    test_local<solist_reclaim_epoch>();
+    test_release<solist_reclaim_epoch>();
+    std::cout << "All Done. " << std::endl;
+    return 0;
+}
@@ -24,9 +24,13 @@ along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
 #include <ctime>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <chrono>
 
 using   benedias::concurrent::solist;
 using   benedias::concurrent::solist_accessor;
+using   benedias::concurrent::solist_maintainer;
+using   benedias::concurrent::solist_growth;
 using   benedias::concurrent::hash_t;
 
 uint32_t values[32] =
@@ -94,12 +98,117 @@ void test_expansion()
     benedias::concurrent::check_solist(sol);
 }
 
+// test split ordered list expansion performed by a maintainer thread.
+void test_deferred_expansion()
+{
+    auto sl = std::make_shared<solist<uint32_t>>(2, 4, solist_growth::deferred_growth);
+    solist_maintainer<uint32_t> maintainer(sl);
+    solist_accessor<uint32_t> sol(sl);
+    uint32_t count = sizeof(values)/sizeof(values[0]);
+
+    for (unsigned ix=0; ix < count; ++ix)
+    {
+        sol.insert_node(values[ix], values[ix]);
+    }
+
+    // Growth is asynchronous, allow the maintainer time to catch up.
+    for (unsigned x=0; x < 100 && sl->size() < 8; ++x)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (sl->size() < 8)
+    {
+        std::cout << "Failed! maintainer did not expand, n_buckets=" << sl->size() << std::endl;
+    }
+
+    for (unsigned ix=0; ix < count; ++ix)
+    {
+        if (nullptr == sol.find_item_node(values[ix]))
+        {
+            std::cout << "Failed! could not find item with hash " << values[ix] << std::endl;
+        }
+    }
+    benedias::concurrent::dump_solist(sol);
+    benedias::concurrent::dump_solist_buckets(sol);
+    benedias::concurrent::check_solist(sol);
+}
+
+// test bucket splitting triggered by lookups, chains are grown
+// with a large max_bucket_length, then the limit is lowered.
+void test_lookup_split()
+{
+    auto sl = std::make_shared<solist<uint32_t>>(2, 64);
+    solist_accessor<uint32_t> sol(sl);
+    uint32_t count = sizeof(values)/sizeof(values[0]);
+
+    for (unsigned ix=0; ix < count; ++ix)
+    {
+        sol.insert_node(values[ix], values[ix]);
+    }
+    uint32_t nbuckets = sl->size();
+    uint32_t chain = benedias::concurrent::longest_chain(*sl);
+    sl->max_bucket_length = 2;
+
+    for (unsigned pass=0; pass < 4; ++pass)
+    {
+        for (unsigned ix=0; ix < count; ++ix)
+        {
+            if (nullptr == sol.find_item_node(values[ix]))
+            {
+                std::cout << "Failed! could not find item with hash " << values[ix] << std::endl;
+            }
+        }
+    }
+    if (sl->size() <= nbuckets)
+    {
+        std::cout << "Failed! lookups did not split buckets, n_buckets=" << sl->size() << std::endl;
+    }
+    if (benedias::concurrent::longest_chain(*sl) >= chain)
+    {
+        std::cout << "Failed! lookups did not shorten chains, longest=" << benedias::concurrent::longest_chain(*sl) << std::endl;
+    }
+    benedias::concurrent::dump_solist(sol);
+    benedias::concurrent::check_solist(sol);
+}
+
+// test lookups of hash values which differ only in the high bits,
+// expanding cannot shorten their chain, so lookups must not expand.
+void test_lookup_collisions()
+{
+    auto sl = std::make_shared<solist<uint32_t>>(2, 4);
+    solist_accessor<uint32_t> sol(sl);
+    constexpr uint32_t count = 12;
+
+    for (uint32_t x = 0; x < count; ++x)
+    {
+        sol.insert_node(x << 27, x);
+    }
+    uint32_t nbuckets = sl->size();
+    for (unsigned x = 0; x < 100; ++x)
+    {
+        if (nullptr == sol.find_item_node((count - 1) << 27))
+        {
+            std::cout << "Failed! could not find item with hash " << ((count - 1) << 27) << std::endl;
+        }
+    }
+    sol.release();
+    std::cout << "colliding hashes, n_buckets " << nbuckets << " after inserts, "
+        << sl->size() << " after lookups" << std::endl;
+    if (sl->size() != nbuckets)
+    {
+        std::cout << "Failed! lookups of colliding hashes expanded the directory" << std::endl;
+    }
+    benedias::concurrent::check_solist(sol);
+}
 
 int main( int argc, char* argv[] )
 {
     std::setlocale(LC_ALL, "en_US.UTF-8");
     std::srand(std::time(nullptr)); // use current time as seed for random generator
     test_expansion();
+    test_deferred_expansion();
+    test_lookup_split();
+    test_lookup_collisions();
     std::cout << "All Done. " << std::endl;
     return 0;
 }